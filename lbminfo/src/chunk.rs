@@ -75,6 +75,7 @@ pub(crate) enum ChunkReaders
 	DeluxePaintThumbnail(dpaint::DeluxePaintThumbnail),
 	DotsPerInch(nonstandard::DotsPerInch),
 	UpdateSpans(custom::UpdateSpans),
+	UpdateSpans2(custom::UpdateSpans2),
 	Body(standard::Body),
 	PhotonPrivate(private::PhotonPrivate),
 	PhotonPrivateScreens(private::PhotonPrivateScreens),
@@ -49,3 +49,51 @@ pub(crate) struct Span
 	pub(crate) innerLeft: i16,
 	pub(crate) innerRight: i16
 }
+
+
+pub(crate) struct UpdateSpans2
+{
+	pub(crate) startOffset: i16,
+	#[allow(dead_code)]
+	pub(crate) numRows: i16,
+	pub(crate) rows: Vec<Vec<Interval>>
+}
+
+impl IFFChunk for UpdateSpans2
+{
+	fn read(file: &mut fs::File, size: usize) -> io::Result<(ChunkReaders, usize)>
+	{
+		let startOffset = file.read_i16be()?;
+		let numRows = file.read_i16be()?;
+		let mut rows = Vec::with_capacity(numRows.max(0) as usize);
+		let mut bytesRead = Self::SIZE as usize;
+		for _ in 0..numRows.max(0)
+		{
+			if bytesRead + 2 > size { break }
+			let numSpans = file.read_u16be()? as usize;
+			bytesRead += 2;
+			let mut row = Vec::with_capacity(numSpans);
+			for _ in 0..numSpans
+			{
+				if bytesRead + 4 > size { break }
+				let left  = file.read_i16be()?;
+				let right = file.read_i16be()?;
+				row.push(Interval { left, right });
+				bytesRead += 4;
+			}
+			rows.push(row);
+		}
+		Ok((ChunkReaders::UpdateSpans2(Self { startOffset, numRows, rows }), bytesRead))
+	}
+
+	const ID: [u8; 4] = *b"SPN2";
+	const SIZE: u32 = 4;
+}
+
+
+#[derive(Default, Clone)]
+pub(crate) struct Interval
+{
+	pub(crate) left: i16,
+	pub(crate) right: i16
+}
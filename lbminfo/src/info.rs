@@ -47,6 +47,7 @@ impl fmt::Display for LBMShortInfo<'_>
 		if lbm.tiny.is_some()        { have.push("TINY"); }
 		if lbm.dpi.is_some()         { have.push("DPI"); }
 		if lbm.spans.is_some()       { have.push("SPAN"); }
+		if lbm.spans2.is_some()      { have.push("SPN2"); }
 		if lbm.body.is_some()        { have.push("BODY"); }
 		write!(fmt, "Type: \"{}\" ({}), Chunks: [{}]", lbm.iffType, lbm.guess(), have.join(","))?;
 		if !lbm.unknown.is_empty()
@@ -247,6 +248,21 @@ impl fmt::Display for LBMFullInfo<'_>
 				}
 			}
 		}
+		if let Some(spans) = &lbm.spans2
+		{
+			writeln!(f, "Update spans (SPN2):")?;
+			for (idx, row) in spans.rows.iter().enumerate()
+			{
+				if row.is_empty() { continue }
+				let idx = spans.startOffset as usize + idx;
+				write!(f, "  [{}]", idx)?;
+				for span in row
+				{
+					write!(f, " {}-{}", span.left, span.right)?;
+				}
+				writeln!(f)?;
+			}
+		}
 		if let Some(body) = &lbm.body
 		{
 			if lbm.header.compression != Compression::NONE { write!(f, "Compressed ")?; }
@@ -8,7 +8,7 @@ use std::io::Seek;
 use crate::chunk::header::LBMHeader;
 use crate::chunk::standard::{Body, ColourMap, Grab};
 use crate::chunk::amiga::CommodoreAmiga;
-use crate::chunk::custom::UpdateSpans;
+use crate::chunk::custom::{UpdateSpans, UpdateSpans2};
 use crate::chunk::range::{CycleRange, EnhancedColourCycle};
 use crate::chunk::graphicraft::CycleInfo;
 use crate::chunk::dpaint::{DeluxePaintPerspective, DeluxePaintPrivateExtended, DeluxePaintPrivateState, DeluxePaintThumbnail};
@@ -41,6 +41,7 @@ pub(crate) struct LBM
 	pub(crate) tiny: Option<DeluxePaintThumbnail>,
 	pub(crate) dpi: Option<DotsPerInch>,
 	pub(crate) spans: Option<UpdateSpans>,
+	pub(crate) spans2: Option<UpdateSpans2>,
 	pub(crate) body: Option<Body>,
 	pub(crate) unknown: HashSet<[u8; 4]>
 }
@@ -100,7 +101,7 @@ impl LBM
 			ranges: lbm.ranges, cycleinfo: lbm.cycleinfo, enhanced: lbm.enhanced,
 			text: lbm.text,
 			dpps: lbm.dpps, dpxt: lbm.dpxt, dppv: lbm.dppv, tiny: lbm.tiny,
-			spans: lbm.spans,
+			spans: lbm.spans, spans2: lbm.spans2,
 			dpi: lbm.dpi,
 			body: lbm.body,
 			unknown })
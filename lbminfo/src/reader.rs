@@ -8,7 +8,7 @@ use crate::chunk::{ChunkReaders, IFFChunk};
 use crate::chunk::header::LBMHeader;
 use crate::chunk::standard::{Body, ColourMap, Grab};
 use crate::chunk::amiga::CommodoreAmiga;
-use crate::chunk::custom::UpdateSpans;
+use crate::chunk::custom::{UpdateSpans, UpdateSpans2};
 use crate::chunk::range::{CycleRange, EnhancedColourCycle};
 use crate::chunk::graphicraft::CycleInfo;
 use crate::chunk::dpaint::{DeluxePaintPerspective, DeluxePaintPrivateExtended, DeluxePaintPrivateState, DeluxePaintThumbnail};
@@ -37,6 +37,7 @@ pub(crate) struct LBMReader
 	pub(crate) tiny: Option<DeluxePaintThumbnail>,
 	pub(crate) dpi: Option<DotsPerInch>,
 	pub(crate) spans: Option<UpdateSpans>,
+	pub(crate) spans2: Option<UpdateSpans2>,
 	pub(crate) body: Option<Body>,
 }
 
@@ -77,6 +78,7 @@ impl LBMReader
 			DeluxePaintThumbnail::tryReadChunk,
 			DotsPerInch::tryReadChunk,
 			UpdateSpans::tryReadChunk,
+			UpdateSpans2::tryReadChunk,
 			Body::tryReadChunk,
 		];
 
@@ -104,6 +106,7 @@ impl LBMReader
 					ChunkReaders::DeluxePaintThumbnail(chunk) => { tryPut!(self.tiny, chunk); },
 					ChunkReaders::DotsPerInch(chunk) => { tryPut!(self.dpi, chunk); },
 					ChunkReaders::UpdateSpans(chunk) => { tryPut!(self.spans, chunk); },
+					ChunkReaders::UpdateSpans2(chunk) => { tryPut!(self.spans2, chunk); },
 					ChunkReaders::Body(chunk) => { tryPut!(self.body, chunk); },
 					_ => continue
 				}
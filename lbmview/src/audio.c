@@ -1,6 +1,7 @@
 /* audio.c - (C) 2023 a dinosaur (zlib) */
 #include "audio.h"
 #include "util.h"
+#include "trace.h"
 #ifdef USE_VORBISFILE
 # include <vorbis/vorbisfile.h>
 # include <stdbool.h>
@@ -70,7 +71,7 @@ static inline void setVolume(uint8_t volume)
 	volumeMul = (volume > 0) ? (int)(volume & 0xFF) + 1 : 0;
 }
 
-static void SDLCALL sdlAudioCallback(void* user, SDL_AudioStream* stream, int additional, int total)
+static void fillStream(SDL_AudioStream* stream, int additional)
 {
 	if (additional <= 0 || volumeMul == 0)
 		return;
@@ -136,6 +137,14 @@ static void SDLCALL sdlAudioCallback(void* user, SDL_AudioStream* stream, int ad
 	}
 }
 
+static void SDLCALL sdlAudioCallback(void* user, SDL_AudioStream* stream, int additional, int total)
+{
+	TRACE_THREAD("audio");
+	TRACE_BEGIN(zone);
+	fillStream(stream, additional);
+	TRACE_END(zone, "sdlAudioCallback");
+}
+
 int audioInit(SDL_Window* window)
 {
 	if (!window)
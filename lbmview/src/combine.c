@@ -0,0 +1,135 @@
+/* combine.c - (C) 2025 a dinosaur (zlib) */
+#include "combine.h"
+#include "util.h"
+#include <SDL3/SDL_cpuinfo.h>
+#include <SDL3/SDL_mutex.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+# define COMBINE_HAVE_AVX2
+# include <immintrin.h>
+# if defined(__GNUC__) || defined(__clang__)
+#  define TARGET_AVX2 __attribute__((target("avx2")))
+# else
+#  define TARGET_AVX2
+# endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+# define COMBINE_HAVE_NEON
+# include <arm_neon.h>
+#endif
+
+
+typedef void (*CombineRowKernel)(Colour* restrict dst, const uint8_t* restrict src, const Colour* restrict pal, size_t len);
+
+static void combineRowScalar(Colour* restrict dst, const uint8_t* restrict src, const Colour* restrict pal, size_t len)
+{
+	size_t i = 0;
+	// Unrolled so the loads can be issued ahead of the stores
+	for (; i + 8 <= len; i += 8)
+	{
+		const Colour c0 = pal[src[i + 0]], c1 = pal[src[i + 1]], c2 = pal[src[i + 2]], c3 = pal[src[i + 3]];
+		const Colour c4 = pal[src[i + 4]], c5 = pal[src[i + 5]], c6 = pal[src[i + 6]], c7 = pal[src[i + 7]];
+		dst[i + 0] = c0, dst[i + 1] = c1, dst[i + 2] = c2, dst[i + 3] = c3;
+		dst[i + 4] = c4, dst[i + 5] = c5, dst[i + 6] = c6, dst[i + 7] = c7;
+	}
+	for (; i < len; ++i)
+		dst[i] = pal[src[i]];
+}
+
+#ifdef COMBINE_HAVE_AVX2
+TARGET_AVX2 static void combineRowAvx2(Colour* restrict dst, const uint8_t* restrict src, const Colour* restrict pal, size_t len)
+{
+	size_t i = 0;
+	for (; i + 16 <= len; i += 16)
+	{
+		const __m128i idx = _mm_loadu_si128((const void*)&src[i]);
+		const __m256i lo = _mm256_i32gather_epi32((const int*)pal, _mm256_cvtepu8_epi32(idx), 4);
+		const __m256i hi = _mm256_i32gather_epi32((const int*)pal, _mm256_cvtepu8_epi32(_mm_srli_si128(idx, 8)), 4);
+		_mm256_storeu_si256((void*)&dst[i], lo);
+		_mm256_storeu_si256((void*)&dst[i + 8], hi);
+	}
+	if (i < len)
+		combineRowScalar(&dst[i], &src[i], pal, len - i);
+}
+#endif
+
+#ifdef COMBINE_HAVE_NEON
+// Building the tables costs about as much as combining a few dozen pixels
+#define NEON_MIN_LEN 64
+
+static void combineRowNeon(Colour* restrict dst, const uint8_t* restrict src, const Colour* restrict pal, size_t len)
+{
+	if (len < NEON_MIN_LEN)
+	{
+		combineRowScalar(dst, src, pal, len);
+		return;
+	}
+
+	// Deinterleave the palette into four byte planes, each split into four 64 byte tables
+	uint8x16x4_t tbl[4][4];
+	for (unsigned k = 0; k < 16; ++k)
+	{
+		const uint8x16x4_t c = vld4q_u8((const uint8_t*)&pal[k * 16]);
+		for (unsigned p = 0; p < 4; ++p)
+			tbl[p][k >> 2].val[k & 3] = c.val[p];
+	}
+
+	size_t i = 0;
+	for (; i + 16 <= len; i += 16)
+	{
+		// Indices outside of a table are left untouched by tbx, so offset them per quarter
+		const uint8x16_t i0 = vld1q_u8(&src[i]);
+		const uint8x16_t i1 = vsubq_u8(i0, vdupq_n_u8(0x40));
+		const uint8x16_t i2 = vsubq_u8(i0, vdupq_n_u8(0x80));
+		const uint8x16_t i3 = vsubq_u8(i0, vdupq_n_u8(0xC0));
+
+		uint8x16x4_t out;
+		for (unsigned p = 0; p < 4; ++p)
+		{
+			uint8x16_t v = vqtbl4q_u8(tbl[p][0], i0);
+			v = vqtbx4q_u8(v, tbl[p][1], i1);
+			v = vqtbx4q_u8(v, tbl[p][2], i2);
+			out.val[p] = vqtbx4q_u8(v, tbl[p][3], i3);
+		}
+		vst4q_u8((uint8_t*)&dst[i], out);
+	}
+	if (i < len)
+		combineRowScalar(&dst[i], &src[i], pal, len - i);
+}
+#endif
+
+
+static CombineRowKernel rowKernel = combineRowScalar;
+static const char* rowKernelName = "Scalar";
+
+// Surfaces can be set up from worker threads, so the kernel is only ever picked once
+void combineInit(void)
+{
+	static SDL_InitState init;
+	if (!SDL_ShouldInit(&init))
+		return;
+#ifdef COMBINE_HAVE_AVX2
+	if (SDL_HasAVX2())
+	{
+		rowKernel = combineRowAvx2;
+		rowKernelName = "AVX2";
+	}
+#endif
+#ifdef COMBINE_HAVE_NEON
+	if (SDL_HasNEON())
+	{
+		rowKernel = combineRowNeon;
+		rowKernelName = "NEON";
+	}
+#endif
+	SDL_SetInitialized(&init, true);
+}
+
+const char* combineKernelName(void)
+{
+	return rowKernelName;
+}
+
+void combineRow(Colour* restrict dst, const uint8_t* restrict src, const Colour* restrict pal, size_t len)
+{
+	rowKernel(dst, src, pal, len);
+}
@@ -0,0 +1,11 @@
+#ifndef COMBINE_H
+#define COMBINE_H
+
+#include "lbm.h"
+
+void combineInit(void);
+const char* combineKernelName(void);
+
+void combineRow(Colour* restrict dst, const uint8_t* restrict src, const Colour* restrict pal, size_t len);
+
+#endif//COMBINE_H
@@ -0,0 +1,138 @@
+/* cycle.c - (C) 2023-2025 a dinosaur (zlib) */
+#include "cycle.h"
+#include "display.h"
+#include <SDL3/SDL.h>
+#include <stdlib.h>
+#include <math.h>
+
+static const double rateScale = (1.0 / (double)CYCLE_MOD);
+
+void cycleInit(Cycle* c, const Lbm* lbm)
+{
+	SDL_memcpy(c->rangeLow, lbm->rangeLow, sizeof(uint8_t) * LBM_MAX_CRNG);
+	SDL_memcpy(c->rangeHigh, lbm->rangeHigh, sizeof(uint8_t) * LBM_MAX_CRNG);
+	SDL_memcpy(c->rangeRate, lbm->rangeRate, sizeof(int16_t) * LBM_MAX_CRNG);
+	c->numRange = lbm->numRange;
+
+	c->clock = 0;
+	for (unsigned i = 0; i < LBM_MAX_CRNG; ++i)
+	{
+		c->cycleSteps[i]  = 0;
+		c->rangeSteps[i]  = 0;
+		c->cycleTimers[i] = 0;
+		c->cyclePos[i]    = 0;
+	}
+}
+
+bool cycleHasAnimation(const Cycle* c)
+{
+	// Does the image contain any usable ranges?
+	for (unsigned i = 0; i < c->numRange; ++i)
+		if (cycleRangeIsUsable(c, i))
+			return true;
+	return false;
+}
+
+bool cycleSeek(Cycle* c, uint64_t t)
+{
+	const uint64_t secs = t / SDL_NS_PER_SECOND, frac = t % SDL_NS_PER_SECOND;
+	bool stepped = false;
+	c->clock = t;
+	for (unsigned i = 0; i < c->numRange; ++i)
+	{
+		if (!c->rangeRate[i])
+			continue;
+
+		uint16_t rate = (uint16_t)abs(c->rangeRate[i]);
+		uint8_t range = c->rangeHigh[i] + 1 - c->rangeLow[i];
+
+		// Exactly floor(rate * 60 * t / 1s), split so neither product overflows for any t
+		const uint64_t perSec = (uint64_t)rate * 60U;
+		const uint64_t ticks = perSec * secs + perSec * frac / SDL_NS_PER_SECOND;
+		const uint64_t steps = ticks / CYCLE_MOD;
+		c->cycleTimers[i] = (uint16_t)(ticks % CYCLE_MOD);
+
+		// Step mode shifts the palette incrementally, so it's told how far each range moved,
+		//  going backwards is just as many steps forward modulo the range's length
+		const uint64_t last = c->cycleSteps[i];
+		c->cycleSteps[i] = steps;
+		const int advance = !range ? 0 : steps >= last
+			? (int)((steps - last) % range)
+			: (int)((range - (last - steps) % range) % range);
+		if (advance)
+		{
+			bool dir = c->rangeRate[i] == (int16_t)rate;
+			const int pos = (int)(steps % range);
+			c->cyclePos[i] = (uint8_t)(dir ? (range - pos) % range : pos);
+			c->rangeSteps[i] = (uint8_t)((c->rangeSteps[i] + advance) % range);
+			if (cycleRangeIsUsable(c, i))
+				stepped = true;
+		}
+	}
+	return stepped;
+}
+
+bool cycleUpdatePalette(Cycle* c, Surface* surf, int method, uint16_t* dirtyRanges)
+{
+	bool changed = true;
+	switch (method)
+	{
+	case DISPLAY_CYCLEMETHOD_STEP:
+		changed = false;
+		for (unsigned i = 0; i < c->numRange; ++i)
+			if (c->rangeSteps[i])
+			{
+				for (unsigned k = 0; k < c->rangeSteps[i]; ++k)
+					if (c->rangeRate[i] > 0)
+						surfacePalShiftRight(surf, c->rangeHigh[i], c->rangeLow[i]);
+					else
+						surfacePalShiftLeft(surf, c->rangeHigh[i], c->rangeLow[i]);
+				*dirtyRanges |= (uint16_t)(1U << i);
+				changed = true;
+			}
+		break;
+	case DISPLAY_CYCLEMETHOD_SRGB:
+		for (unsigned i = 0; i < c->numRange; ++i)
+			surfaceRangeSrgb(surf, c->rangeHigh[i], c->rangeLow[i], c->cyclePos[i],
+				copysign((double)c->cycleTimers[i] * rateScale, -c->rangeRate[i]));
+		break;
+	case DISPLAY_CYCLEMETHOD_LINEAR:
+		for (unsigned i = 0; i < c->numRange; ++i)
+			surfaceRangeLinear(surf, c->rangeHigh[i], c->rangeLow[i], c->cyclePos[i],
+				copysign((double)c->cycleTimers[i] * rateScale, -c->rangeRate[i]));
+		break;
+	case DISPLAY_CYCLEMETHOD_HSLUV:
+		for (unsigned i = 0; i < c->numRange; ++i)
+			surfaceRangeHsluv(surf, c->rangeHigh[i], c->rangeLow[i], c->cyclePos[i],
+				copysign((double)c->cycleTimers[i] * rateScale, -c->rangeRate[i]));
+		break;
+	case DISPLAY_CYCLEMETHOD_LAB:
+		for (unsigned i = 0; i < c->numRange; ++i)
+			surfaceRangeLab(surf, c->rangeHigh[i], c->rangeLow[i], c->cyclePos[i],
+				copysign((double)c->cycleTimers[i] * rateScale, -c->rangeRate[i]));
+		break;
+	case DISPLAY_CYCLEMETHOD_OKLAB:
+		for (unsigned i = 0; i < c->numRange; ++i)
+			surfaceRangeOklab(surf, c->rangeHigh[i], c->rangeLow[i], c->cyclePos[i],
+				copysign((double)c->cycleTimers[i] * rateScale, -c->rangeRate[i]));
+		break;
+	case DISPLAY_CYCLEMETHOD_OKLCH:
+		for (unsigned i = 0; i < c->numRange; ++i)
+			surfaceRangeOklch(surf, c->rangeHigh[i], c->rangeLow[i], c->cyclePos[i],
+				copysign((double)c->cycleTimers[i] * rateScale, -c->rangeRate[i]));
+		break;
+	default:
+		changed = false;
+		break;
+	}
+	// Steps accumulate while nothing is drawn, and are reflected in cyclePos for the blended methods
+	SDL_memset(c->rangeSteps, 0, sizeof(c->rangeSteps));
+	return changed;
+}
+
+void cycleResetPalette(Cycle* c, Surface* surf)
+{
+	for (unsigned i = 0; i < c->numRange; ++i)
+		surfaceRange(surf, c->rangeHigh[i], c->rangeLow[i], c->cyclePos[i]);
+	SDL_memset(c->rangeSteps, 0, sizeof(c->rangeSteps));
+}
@@ -0,0 +1,40 @@
+#ifndef CYCLE_H
+#define CYCLE_H
+
+#include "surface.h"
+#include <stdbool.h>
+
+#define CYCLE_MOD 0x4000
+
+// Colour cycling state of one image, a pure function of the clock so any time can be jumped to
+typedef struct
+{
+	uint8_t rangeLow[LBM_MAX_CRNG];
+	uint8_t rangeHigh[LBM_MAX_CRNG];
+	int16_t rangeRate[LBM_MAX_CRNG];
+	unsigned numRange;
+
+	uint64_t clock;
+	uint64_t cycleSteps[LBM_MAX_CRNG];
+	uint8_t rangeSteps[LBM_MAX_CRNG];  // Steps step mode has yet to shift the palette by
+	uint16_t cycleTimers[LBM_MAX_CRNG];
+	uint8_t cyclePos[LBM_MAX_CRNG];
+} Cycle;
+
+static inline bool cycleRangeIsUsable(const Cycle* c, unsigned i)
+{
+	return c->rangeRate[i] && c->rangeHigh[i] > c->rangeLow[i];
+}
+
+// Copies the image's ranges & rewinds to the start
+void cycleInit(Cycle* c, const Lbm* lbm);
+bool cycleHasAnimation(const Cycle* c);
+// Puts every range where it is t nanoseconds in, true if any visible range stepped
+bool cycleSeek(Cycle* c, uint64_t t);
+// Brings the surface palette up to the clock with one of DisplayCycleMethod,
+//  true if it changed & ranges step mode shifted are added to dirtyRanges
+bool cycleUpdatePalette(Cycle* c, Surface* surf, int method, uint16_t* dirtyRanges);
+// Sets the unblended palette at the current positions, for switching into step mode
+void cycleResetPalette(Cycle* c, Surface* surf);
+
+#endif//CYCLE_H
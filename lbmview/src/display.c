@@ -1,7 +1,11 @@
 /* display.c - (C) 2023-2025 a dinosaur (zlib) */
 #include "display.h"
 #include "surface.h"
+#include "cycle.h"
+#include "spancache.h"
 #include "text.h"
+#include "workpool.h"
+#include "trace.h"
 #include "util.h"
 #include <SDL3/SDL.h>
 #include <stdlib.h>
@@ -13,40 +17,76 @@ struct Display
 	SDL_Renderer* rend;
 
 	Surface surf;
+	WorkPool* pool;
 	SDL_Texture* surfTex;
+	SDL_Palette* surfPal;
 	bool surfDamage;
+	bool wantIndexed, indexed;
 	SDL_FRect surfRect;
 
-	uint8_t rangeLow[LBM_MAX_CRNG];
-	uint8_t rangeHigh[LBM_MAX_CRNG];
-	int16_t rangeRate[LBM_MAX_CRNG];
-	unsigned numRange;
+	// The clock asked for, cyc only catches up to it where the palette is updated
+	Cycle cyc;
+	uint64_t clock;
+	uint16_t dirtyRanges;
 
 	double srcAspect;
 	int scrW, scrH;
 	int textScale;
 
-	bool rangeTrigger[LBM_MAX_CRNG];
-	float cycleTimers[LBM_MAX_CRNG];
-	uint8_t cyclePos[LBM_MAX_CRNG];
-
 	int cycleMethod;
 	bool spanView, palView;
+	// Span overlay quads, kept until the spans or where the picture sits change
+	SDL_Vertex* spanVerts;
+	int* spanIndices;
+	int numSpanQuads;
+	bool spanGeomValid;
+	SDL_FRect spanGeomRect;
+	SDL_Texture* palTex;
 	bool repaint, hasAnim;
 
 	Font font;
 	const char* text;
 	float textTimer;
+	TextLayout textLayout;
+	bool textLayoutValid;
+	const char* hud;
+	TextLayout hudLayout;
+	bool hudLayoutValid;
+
+	// Timings of the frame in progress & the last one finished
+	DisplayFrameStats stats, lastStats;
+	uint64_t numFrames;
+
+	// Producer thread that runs a frame ahead, owns the cycle state & surface while a frame is pending
+	SDL_Thread* pipeThread;
+	SDL_Semaphore* pipeRequest;
+	SDL_Semaphore* pipeDone;  // Signalled once for every frame requested
+	SDL_AtomicInt pipeReady;  // Index of the finished frame, or -1
+	Colour* pipeFrames[2];
+	bool pipeFresh[2];
+	uint64_t pipeReqClock;
+	DisplayFrameStats pipeStats[2];  // What the producer spent on each buffer
+	bool wantPipelined, pipelined, pipePending, pipeUploadWhole, pipeQuit;
+	Colour shownPal[LBM_PAL_SIZE];
+
+	// Software rendering draws the picture straight into the window surface, see repaintDirect()
+	bool softDirect, directFull;
+	int* scaleMap;  // Source columns then rows, see surfaceCombineScaled()
+	SDL_Rect scaleRect;
+	Uint64 directPeriod, directPresented;
 };
 
 #define TEXT_TIME_END  7.0f
 #define TEXT_TIME_FADE 5.0f
 
 static void recalcDisplayRect(Display* d, int w, int h, double aspect);
+static void startPipeline(Display* d);
+static void stopPipeline(Display* d);
+static bool isSoftwareRenderer(SDL_Renderer* rend);
 
-Display* displayInit(SDL_Renderer* renderer, const Lbm* lbm, const void* precompSpans, size_t precompSpansLen)
+Display* displayInit(SDL_Renderer* renderer, const Lbm* lbm, const void* precompSpans, size_t precompSpansLen, int precompSpansVer)
 {
-	if (!renderer || !lbm)
+	if (!lbm)
 		return NULL;
 
 	Display* d = SDL_malloc(sizeof(Display));
@@ -58,9 +98,15 @@ Display* displayInit(SDL_Renderer* renderer, const Lbm* lbm, const void* precomp
 		.rend = renderer,
 
 		.surf       = SURFACE_CLEAR(),
+		.pool       = NULL,
 		.surfTex    = NULL,
+		.surfPal    = NULL,
 		.surfDamage = false,
-		.numRange   = 0U,
+		.cyc.numRange = 0U,
+
+		// Set by displayToggleIndexed()
+		.wantIndexed = false,
+		.indexed     = false,
 
 		// Set by displayResize()
 		.surfRect = { 0.f, 0.f, 0.f, 0.f },
@@ -71,6 +117,11 @@ Display* displayInit(SDL_Renderer* renderer, const Lbm* lbm, const void* precomp
 		.cycleMethod = DISPLAY_CYCLEMETHOD_SRGB,
 		.spanView = false,
 		.palView  = false,
+		.spanVerts   = NULL,
+		.spanIndices = NULL,
+		.numSpanQuads  = 0,
+		.spanGeomValid = false,
+		.palTex = NULL,
 		.repaint  = false,
 		.hasAnim  = false,
 
@@ -80,24 +131,74 @@ Display* displayInit(SDL_Renderer* renderer, const Lbm* lbm, const void* precomp
 			.tex = NULL
 		},
 		.text = NULL,
-		.textTimer = 0.0f
+		.textTimer = 0.0f,
+		.textLayout = TEXTLAYOUT_CLEAR(),
+		.textLayoutValid = false,
+		.hud = NULL,
+		.hudLayout = TEXTLAYOUT_CLEAR(),
+		.hudLayoutValid = false,
+
+		.stats = { .pixels = 0 },
+		.lastStats = { .pixels = 0 },
+		.numFrames = 0,
+
+		.pipeThread  = NULL,
+		.pipeRequest = NULL,
+		.pipeDone    = NULL,
+		.pipeFrames  = { NULL, NULL },
+		.pipeReqClock = 0,
+		.wantPipelined = true,
+		.pipelined     = false,
+		.pipePending   = false,
+		.pipeQuit      = false,
+
+		.softDirect = false,
+		.directFull = true,
+		.scaleMap   = NULL,
+		.directPeriod = 0, .directPresented = 0
 	};
+	SDL_SetAtomicInt(&d->pipeReady, -1);
 
 	d->rend = renderer;
-	if (displayReset(d, lbm, precompSpans, precompSpansLen))
+	d->pool = workPoolCreate(SDL_GetNumLogicalCPUCores() - 1);
+	d->softDirect = renderer && isSoftwareRenderer(renderer) && SDL_GetRenderWindow(renderer);
+	if (displayReset(d, lbm, precompSpans, precompSpansLen, precompSpansVer))
 	{
 		displayFree(d);
 		return NULL;
 	}
 
-	textCreateFontTexture(&d->font);
+	if (renderer)
+		textCreateFontTexture(&d->font);
 
 	return d;
 }
 
-static void freeResources(Display* d)
+static void freeSurfaceTexture(Display* d)
 {
 	SDL_DestroyTexture(d->surfTex);
+	d->surfTex = NULL;
+	SDL_DestroyPalette(d->surfPal);
+	d->surfPal = NULL;
+	d->indexed = false;
+}
+
+static void freeResources(Display* d)
+{
+	stopPipeline(d);
+	for (unsigned i = 0; i < 2; ++i)
+	{
+		free(d->pipeFrames[i]);
+		d->pipeFrames[i] = NULL;
+	}
+	free(d->scaleMap);
+	d->scaleMap = NULL;
+	free(d->spanVerts);
+	free(d->spanIndices);
+	d->spanVerts = NULL;
+	d->spanIndices = NULL;
+	d->spanGeomValid = false;
+	freeSurfaceTexture(d);
 	surfaceFree(&d->surf);
 }
 
@@ -106,23 +207,116 @@ void displayFree(Display* d)
 	if (!d)
 		return;
 	freeResources(d);
+	if (d->pipeThread)
+	{
+		d->pipeQuit = true;
+		SDL_SignalSemaphore(d->pipeRequest);
+		SDL_WaitThread(d->pipeThread, NULL);
+	}
+	SDL_DestroySemaphore(d->pipeRequest);
+	SDL_DestroySemaphore(d->pipeDone);
+	workPoolFree(d->pool);
+	SDL_DestroyTexture(d->palTex);
+	textLayoutFree(&d->textLayout);
+	textLayoutFree(&d->hudLayout);
 	SDL_DestroyTexture(d->font.tex);
 	SDL_free(d);
 }
 
-static bool hasAnimation(const Display* d)
+// Renderers that back streaming textures with a CPU side copy which survives between locks,
+//  the rest may hand out write-only staging memory that would lose everything outside the spans
+static bool textureLockIsPersistent(SDL_Renderer* rend)
 {
-	if (!d->numRange)
+	const char* name = SDL_GetRendererName(rend);
+	if (!name)
 		return false;
+	return !SDL_strcmp(name, SDL_SOFTWARE_RENDERER)
+		|| !SDL_strcmp(name, "opengl")
+		|| !SDL_strcmp(name, "opengles2");
+}
 
-	// Does the image contain any usable ranges?
-	for (unsigned i = 0; i < d->numRange; ++i)
-		if (d->rangeRate[i] && d->rangeHigh[i] > d->rangeLow[i])
+bool isSoftwareRenderer(SDL_Renderer* rend)
+{
+	const char* name = SDL_GetRendererName(rend);
+	return name && !SDL_strcmp(name, SDL_SOFTWARE_RENDERER);
+}
+
+static bool rendererSupportsFormat(SDL_Renderer* rend, SDL_PixelFormat format)
+{
+	const SDL_PixelFormat* formats = SDL_GetPointerProperty(SDL_GetRendererProperties(rend),
+		SDL_PROP_RENDERER_TEXTURE_FORMATS_POINTER, NULL);
+	if (!formats)
+		return false;
+	for (; *formats != SDL_PIXELFORMAT_UNKNOWN; ++formats)
+		if (*formats == format)
 			return true;
 	return false;
 }
 
-int displayReset(Display* d, const Lbm* lbm, const void* precompSpans, size_t precompSpansLen)
+static int createIndexedTexture(Display* d)
+{
+#if SDL_VERSION_ATLEAST(3, 4, 0)
+	// Opt-in via displayToggleIndexed(), the software renderer remaps every pixel on each draw
+	//  & gives up the direct path while indexed, so BGRA stays the default there like everywhere
+	if (!rendererSupportsFormat(d->rend, SDL_PIXELFORMAT_INDEX8))
+		return -1;
+
+	d->surfTex = SDL_CreateTexture(d->rend,
+		SDL_PIXELFORMAT_INDEX8,
+		SDL_TEXTUREACCESS_STATIC,
+		d->surf.w, d->surf.h);
+	d->surfPal = SDL_CreatePalette(LBM_PAL_SIZE);
+	if (!d->surfTex || !d->surfPal
+		|| !SDL_SetTexturePalette(d->surfTex, d->surfPal)
+		|| !SDL_UpdateTexture(d->surfTex, NULL, d->surf.srcPix, d->surf.w))
+	{
+		freeSurfaceTexture(d);
+		return -1;
+	}
+	d->indexed = true;
+	return 0;
+#else
+	return -1;
+#endif
+}
+
+static int createSurfaceTexture(Display* d)
+{
+	freeSurfaceTexture(d);
+
+	// Headless displays only ever combine into memory
+	if (!d->rend)
+	{
+		if (surfaceAllocComb(&d->surf))
+			return -1;
+		d->surf.combFull = true;
+		d->surfDamage = true;
+		return 0;
+	}
+
+	// Indices only need uploading once, after which only the palette changes
+	if (!d->wantIndexed || createIndexedTexture(d))
+	{
+		d->surfTex = SDL_CreateTexture(d->rend,
+			SDL_PIXELFORMAT_BGRA32,
+			SDL_TEXTUREACCESS_STREAMING,
+			d->surf.w, d->surf.h);
+		if (!d->surfTex)
+			return -1;
+
+		// Combine straight into the texture when possible, otherwise keep a copy to upload from
+		if (!textureLockIsPersistent(d->rend) && surfaceAllocComb(&d->surf))
+			return -1;
+	}
+	SDL_SetTextureBlendMode(d->surfTex, SDL_BLENDMODE_NONE);
+	SDL_SetTextureScaleMode(d->surfTex, SDL_SCALEMODE_NEAREST);
+
+	d->surf.combFull = true;
+	d->surfDamage = true;
+	return 0;
+}
+
+int displayReset(Display* d, const Lbm* lbm, const void* precompSpans, size_t precompSpansLen, int precompSpansVer)
 {
 	if (!d || !lbm)
 		return -1;
@@ -132,43 +326,44 @@ int displayReset(Display* d, const Lbm* lbm, const void* precompSpans, size_t pr
 	// Create surface
 	if (surfaceInit(&d->surf, lbm->w, lbm->h, lbm->pixels, lbm->palette))
 		return -1;
-	// copy ranges
-	SDL_memcpy(d->rangeLow, lbm->rangeLow, sizeof(uint8_t) * LBM_MAX_CRNG);
-	SDL_memcpy(d->rangeHigh, lbm->rangeHigh, sizeof(uint8_t) * LBM_MAX_CRNG);
-	SDL_memcpy(d->rangeRate, lbm->rangeRate, sizeof(int16_t) * LBM_MAX_CRNG);
-	d->numRange = lbm->numRange;
-	d->hasAnim  = hasAnimation(d);
-	if (precompSpans)
-		surfaceLoadSpans(&d->surf, precompSpans, precompSpansLen);
-	else if (d->hasAnim)
-		surfaceComputeSpans(&d->surf, d->rangeHigh, d->rangeLow, d->rangeRate, (int)d->numRange);
-	surfaceCombine(&d->surf);
+	// Copy ranges, the clock starts over
+	cycleInit(&d->cyc, lbm);
+	d->hasAnim = cycleHasAnimation(&d->cyc);
+	int spansErr = -1;
+	if (precompSpans && precompSpansVer == 2)
+		spansErr = surfaceLoadSpans2(&d->surf, precompSpans, precompSpansLen);
+	else if (precompSpans)
+		spansErr = surfaceLoadSpans(&d->surf, precompSpans, precompSpansLen);
+	if (spansErr && d->hasAnim)
+	{
+		// Files without precomputed spans have them cached on disk between runs
+		const uint64_t key = spanCacheKey(&d->surf, d->cyc.rangeHigh, d->cyc.rangeLow, d->cyc.rangeRate, (int)d->cyc.numRange);
+		if (spanCacheLoad(&d->surf, key) &&
+			!surfaceComputeSpans(&d->surf, d->cyc.rangeHigh, d->cyc.rangeLow, d->cyc.rangeRate, (int)d->cyc.numRange, d->pool))
+			spanCacheStore(&d->surf, key);
+	}
+	if (d->hasAnim)
+	{
+		surfaceComputeRuns(&d->surf, d->cyc.rangeHigh, d->cyc.rangeLow, d->cyc.rangeRate, (int)d->cyc.numRange);
+		surfaceComputeTiles(&d->surf, d->cyc.rangeHigh, d->cyc.rangeLow, d->cyc.rangeRate, (int)d->cyc.numRange);
+	}
 
 	// Create destination surface texure
-	d->surfTex = SDL_CreateTexture(d->rend,
-		SDL_PIXELFORMAT_BGRA32,
-		SDL_TEXTUREACCESS_STREAMING,
-		d->surf.w, d->surf.h);
-	if (!d->surfTex)
+	if (createSurfaceTexture(d))
 		return -1;
-	SDL_SetTextureBlendMode(d->surfTex, SDL_BLENDMODE_NONE);
-	SDL_SetTextureScaleMode(d->surfTex, SDL_SCALEMODE_NEAREST);
 
 	// Initial display resize
-	int backBufferW, backBufferH;
-	SDL_GetCurrentRenderOutputSize(d->rend, &backBufferW, &backBufferH);
+	int backBufferW = d->surf.w, backBufferH = d->surf.h;
+	if (d->rend)
+		SDL_GetCurrentRenderOutputSize(d->rend, &backBufferW, &backBufferH);
 	displayResize(d, backBufferW, backBufferH);
 
-	// Reset cycle arrays
-	for (unsigned i = 0; i < LBM_MAX_CRNG; ++i)
-	{
-		d->rangeTrigger[i] = false;
-		d->cycleTimers[i]  = 0.0f;
-		d->cyclePos[i]     = 0;
-	}
+	d->clock = 0;
+	d->dirtyRanges = 0;
 
 	d->surfDamage = true;
 	displayDamage(d);
+	startPipeline(d);
 	return 0;
 }
 
@@ -180,7 +375,7 @@ bool displayHasAnimation(const Display* d)
 
 bool displayIsTextShown(const Display* d)
 {
-	if (d && d->text && d->textTimer < TEXT_TIME_END)
+	if (d && ((d->text && d->textTimer < TEXT_TIME_END) || d->hud))
 		return true;
 	return false;
 }
@@ -188,72 +383,89 @@ bool displayIsTextShown(const Display* d)
 
 static void drawPalette(Display* d, int size)
 {
-	for (unsigned i = 0; i < LBM_PAL_SIZE; ++i)
+	if (!d->palTex)
 	{
-		int x = (int)(i & 0xF) * size;
-		int y = (int)(i >> 4) * size;
-
-		Colour c = d->surf.pal[i];
-		SDL_SetRenderDrawColor(d->rend, COLOUR_R(c), COLOUR_G(c), COLOUR_B(c), COLOUR_A(c));
-
-		const SDL_FRect dst = { .x = (float)x, .y = (float)y, .w = (float)size, .h = (float)size };
-		SDL_RenderFillRect(d->rend, &dst);
+		d->palTex = SDL_CreateTexture(d->rend, SDL_PIXELFORMAT_BGRA32, SDL_TEXTUREACCESS_STREAMING, 16, 16);
+		if (!d->palTex)
+			return;
+		SDL_SetTextureBlendMode(d->palTex, SDL_BLENDMODE_NONE);
+		SDL_SetTextureScaleMode(d->palTex, SDL_SCALEMODE_NEAREST);
 	}
+
+	// The producer may be busy with the next palette, show the one matching the picture
+	const Colour* pal = d->pipelined ? d->shownPal : d->surf.pal;
+	SDL_UpdateTexture(d->palTex, NULL, pal, 16 * sizeof(Colour));
+	const float len = (float)(size * 16);
+	SDL_RenderTexture(d->rend, d->palTex, NULL, &(SDL_FRect){ 0.f, 0.f, len, len });
 }
 
-static void drawSpans(Display* d)
+static void buildSpanGeometry(Display* d)
 {
-	if (!d->surf.spans)
-		return;
+	d->spanGeomValid = true;
+	d->spanGeomRect = d->surfRect;
 
-	// Save current renderer state
-	SDL_Color oldColour;
-	SDL_BlendMode oldMode;
-	SDL_GetRenderDrawColor(d->rend, &oldColour.r, &oldColour.g, &oldColour.b, &oldColour.a);
-	SDL_GetRenderDrawBlendMode(d->rend, &oldMode);
-
-	// Alpha blend spans over scene
-	SDL_SetRenderDrawBlendMode(d->rend, SDL_BLENDMODE_BLEND);
-	const Uint8 alpha = 0x3F;
-
-	// Compute scale factors
-	float sw = d->surfRect.w / (float)d->surf.w;
-	float sh = d->surfRect.h / (float)d->surf.h;
+	const int numSpans = (int)d->surf.spanRows[d->surf.spanEnd + 1 - d->surf.spanBeg];
+	if (numSpans != d->numSpanQuads || !d->spanVerts)
+	{
+		free(d->spanVerts);
+		free(d->spanIndices);
+		d->spanVerts = malloc(sizeof(SDL_Vertex) * 4 * (size_t)numSpans);
+		d->spanIndices = malloc(sizeof(int) * 6 * (size_t)numSpans);
+		d->numSpanQuads = d->spanVerts && d->spanIndices ? numSpans : 0;
+	}
+	if (!d->numSpanQuads)
+		return;
 
-	const SurfSpan* spans = d->surf.spans;
-	SDL_FRect fdst = { 0, 0, 0, sh };
+	// Lone spans in red, rows split into several alternate blue & green
+	const float alpha = (float)0x3F / 255.f;
+	const SDL_FColor lone = { 1.f, 0.f, (float)0x6E / 255.f, alpha };
+	const SDL_FColor odd  = { 0.f, 1.f, (float)0x06 / 255.f, alpha };
+	const SDL_FColor even = { 0.f, (float)0x66 / 255.f, 1.f, alpha };
+
+	const float sw = d->surfRect.w / (float)d->surf.w;
+	const float sh = d->surfRect.h / (float)d->surf.h;
+	SDL_Vertex* v = d->spanVerts;
+	int* idx = d->spanIndices;
+	int base = 0;
 	for (int i = d->surf.spanBeg; i <= d->surf.spanEnd; ++i)
 	{
-		SurfSpan span = (*spans++);
-		if (span.l < 0) // Skip empties
-			continue;
-
-		fdst.y = d->surfRect.y + (float)i * sh;
-		if (span.inL < 0)
+		const uint32_t beg = d->surf.spanRows[i - d->surf.spanBeg];
+		const uint32_t end = d->surf.spanRows[i - d->surf.spanBeg + 1];
+		const float y0 = d->surfRect.y + (float)i * sh, y1 = y0 + sh;
+		for (uint32_t k = beg; k < end; ++k, v += 4, idx += 6, base += 4)
 		{
-			// Fill contiguous spans in red
-			SDL_SetRenderDrawColor(d->rend, 0xFF, 0x00, 0x6E, alpha);
-			fdst.x = d->surfRect.x + (float)span.l * sw;
-			fdst.w = (1.0f + (float)span.r - (float)span.l) * sw;
-			SDL_RenderFillRect(d->rend, &fdst);
-		}
-		else
-		{
-			// Fill split span (left portion in blue)
-			SDL_SetRenderDrawColor(d->rend, 0x00, 0x66, 0xFF, alpha);
-			fdst.x = d->surfRect.x + (float)span.l * sw;
-			fdst.w = ((float)span.inL - (float)span.l) * sw;
-			SDL_RenderFillRect(d->rend, &fdst);
-			// (Right portion in green)
-			SDL_SetRenderDrawColor(d->rend, 0x00, 0xFF, 0x06, alpha);
-			fdst.x = d->surfRect.x + (1.0f + (float)span.inR) * sw;
-			fdst.w = ((float)span.r - (float)span.inR) * sw;
-			SDL_RenderFillRect(d->rend, &fdst);
+			const SDL_FColor c = end - beg == 1 ? lone : (k - beg) & 0x1 ? odd : even;
+			const SurfSpan span = d->surf.spans[k];
+			const float x0 = d->surfRect.x + (float)span.l * sw;
+			const float x1 = x0 + (1.0f + (float)span.r - (float)span.l) * sw;
+			v[0] = (SDL_Vertex){ { x0, y0 }, c, { 0.f, 0.f } };
+			v[1] = (SDL_Vertex){ { x1, y0 }, c, { 0.f, 0.f } };
+			v[2] = (SDL_Vertex){ { x1, y1 }, c, { 0.f, 0.f } };
+			v[3] = (SDL_Vertex){ { x0, y1 }, c, { 0.f, 0.f } };
+			idx[0] = base;
+			idx[1] = base + 1;
+			idx[2] = base + 2;
+			idx[3] = base;
+			idx[4] = base + 2;
+			idx[5] = base + 3;
 		}
 	}
+}
 
-	// Restore previous render state
-	SDL_SetRenderDrawColor(d->rend, oldColour.r, oldColour.g, oldColour.b, oldColour.a);
+static void drawSpans(Display* d)
+{
+	if (!d->surf.spans || d->surf.spanBeg < 0)
+		return;
+	if (!d->spanGeomValid || SDL_memcmp(&d->spanGeomRect, &d->surfRect, sizeof(SDL_FRect)))
+		buildSpanGeometry(d);
+	if (!d->numSpanQuads)
+		return;
+
+	// Alpha blend spans over scene, all in one batch
+	SDL_BlendMode oldMode;
+	SDL_GetRenderDrawBlendMode(d->rend, &oldMode);
+	SDL_SetRenderDrawBlendMode(d->rend, SDL_BLENDMODE_BLEND);
+	SDL_RenderGeometry(d->rend, NULL, d->spanVerts, d->numSpanQuads * 4, d->spanIndices, d->numSpanQuads * 6);
 	SDL_SetRenderDrawBlendMode(d->rend, oldMode);
 }
 
@@ -286,80 +498,408 @@ void recalcDisplayRect(Display* d, int w, int h, double aspect)
 }
 
 
-#define CYCLE_MOD 0x4000
-static const double rateScale = (1.0 / (double)CYCLE_MOD);
+static inline bool FORCE_INLINE rangeIsUsable(const Display* d, unsigned i)
+{
+	return cycleRangeIsUsable(&d->cyc, i);
+}
 
-void displayUpdateTimer(Display* d, double delta)
+void displaySeek(Display* d, uint64_t t)
 {
 	if (!d)
 		return;
-	for (unsigned i = 0; i < d->numRange; ++i)
+
+	const Uint64 start = SDL_GetTicksNS();
+	const bool moved = t != d->clock;
+	d->clock = t;
+	// The producer owns the cycle state while pipelined, it catches up on the next frame requested
+	if (!d->pipelined && cycleSeek(&d->cyc, t))
+		d->repaint = true;
+
+	// Blended methods change with every tick of the clock
+	if (d->hasAnim && d->cycleMethod != DISPLAY_CYCLEMETHOD_STEP && moved)
+		d->repaint = true;
+	d->stats.stageNs[DISPLAY_STAGE_SEEK] += SDL_GetTicksNS() - start;
+}
+
+double displayTimeToNextChange(const Display* d, double timescale)
+{
+	if (!d)
+		return INFINITY;
+
+	double next = INFINITY;
+	if (d->text && d->textTimer < TEXT_TIME_END)
+		next = d->textTimer < TEXT_TIME_FADE ? (double)(TEXT_TIME_FADE - d->textTimer) : 0.0;
+	if (!d->hasAnim || timescale <= 0.0)
+		return next;
+	if (d->cycleMethod != DISPLAY_CYCLEMETHOD_STEP)
+		return 0.0;
+
+	// Step mode only changes when a range's timer next wraps
+	for (unsigned i = 0; i < d->cyc.numRange; ++i)
 	{
-		d->rangeTrigger[i] = false;
-		if (!d->rangeRate[i])
+		if (!rangeIsUsable(d, i))
 			continue;
+		const double rate = abs(d->cyc.rangeRate[i]) * 60.0 * timescale;
+		next = MIN(next, MAX(0.0, (double)CYCLE_MOD - (double)d->cyc.cycleTimers[i]) / rate);
+	}
+	return next;
+}
 
-		uint16_t rate = (uint16_t)abs(d->rangeRate[i]);
-		uint8_t range = d->rangeHigh[i] + 1 - d->rangeLow[i];
+static uint64_t gcd64(uint64_t a, uint64_t b)
+{
+	while (b)
+	{
+		const uint64_t t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
 
-		d->cycleTimers[i] += (float)(rate * 60.0 * delta);
-		if (d->cycleTimers[i] >= (float)CYCLE_MOD)
+double displayLoopPeriod(const Display* d)
+{
+	if (!d || !d->hasAnim)
+		return 0.0;
+
+	// Ranges no pixel uses can't hold the picture back from repeating
+	bool used[LBM_PAL_SIZE] = { false };
+	for (size_t i = 0; i < (size_t)d->surf.w * (size_t)d->surf.h; ++i)
+		used[d->surf.srcPix[i]] = true;
+
+	// Each range comes back around after (range length * CYCLE_MOD) / (rate * 60) seconds,
+	//  the whole picture after the lowest common multiple of those
+	uint64_t num = 0, den = 1;
+	for (unsigned i = 0; i < d->cyc.numRange; ++i)
+	{
+		if (!rangeIsUsable(d, i))
+			continue;
+		unsigned k = d->cyc.rangeLow[i];
+		while (k <= d->cyc.rangeHigh[i] && !used[k])
+			++k;
+		if (k > d->cyc.rangeHigh[i])
+			continue;
+		uint64_t a = (uint64_t)(d->cyc.rangeHigh[i] + 1 - d->cyc.rangeLow[i]) * CYCLE_MOD;
+		uint64_t b = (uint64_t)abs(d->cyc.rangeRate[i]) * 60U;
+		const uint64_t g = gcd64(a, b);
+		a /= g;
+		b /= g;
+		if (!num)
 		{
-			d->cycleTimers[i] = efmodf(d->cycleTimers[i], CYCLE_MOD);
-			bool dir = d->rangeRate[i] == (int16_t)rate;
-			d->cyclePos[i] = (uint8_t)emod(d->cyclePos[i] + (dir ? -1 : 1), range);
-			d->rangeTrigger[i] = true;
+			num = a;
+			den = b;
+			continue;
 		}
+		const uint64_t scale = a / gcd64(num, a);
+		if (num > UINT64_MAX / scale)
+			return INFINITY;
+		num *= scale;
+		den = gcd64(den, b);
 	}
+	return num ? (double)num / (double)den : 0.0;
 }
 
 void displayUpdateTextDisplay(Display* d, double delta)
 {
 	if (d && d->text && d->textTimer < TEXT_TIME_END)
+	{
 		d->textTimer += (float)delta;
+		if (d->textTimer > TEXT_TIME_FADE)
+			d->repaint = true;
+	}
 }
 
-static void updatePalette(Display* d)
-{
-	switch (d->cycleMethod)
-	{
-	case DISPLAY_CYCLEMETHOD_STEP:
-		for (unsigned i = 0; i < d->numRange; ++i)
-			if (d->rangeTrigger[i])
-			{
-				if (d->rangeRate[i] > 0)
-					surfacePalShiftRight(&d->surf, d->rangeHigh[i], d->rangeLow[i]);
-				else
-					surfacePalShiftLeft(&d->surf, d->rangeHigh[i], d->rangeLow[i]);
-				d->surfDamage = true;
-			}
-		break;
-	case DISPLAY_CYCLEMETHOD_SRGB:
-		for (unsigned i = 0; i < d->numRange; ++i)
-			surfaceRangeSrgb(&d->surf, d->rangeHigh[i], d->rangeLow[i], d->cyclePos[i],
-				copysign((double)d->cycleTimers[i] * rateScale, -d->rangeRate[i]));
-		d->surfDamage = true;
-		break;
-	case DISPLAY_CYCLEMETHOD_LINEAR:
-		for (unsigned i = 0; i < d->numRange; ++i)
-			surfaceRangeLinear(&d->surf, d->rangeHigh[i], d->rangeLow[i], d->cyclePos[i],
-				copysign((double)d->cycleTimers[i] * rateScale, -d->rangeRate[i]));
-		d->surfDamage = true;
-		break;
-	case DISPLAY_CYCLEMETHOD_HSLUV:
-		for (unsigned i = 0; i < d->numRange; ++i)
-			surfaceRangeHsluv(&d->surf, d->rangeHigh[i], d->rangeLow[i], d->cyclePos[i],
-				copysign((double)d->cycleTimers[i] * rateScale, -d->rangeRate[i]));
-		d->surfDamage = true;
-		break;
-	case DISPLAY_CYCLEMETHOD_LAB:
-		for (unsigned i = 0; i < d->numRange; ++i)
-			surfaceRangeLab(&d->surf, d->rangeHigh[i], d->rangeLow[i], d->cyclePos[i],
-				copysign((double)d->cycleTimers[i] * rateScale, -d->rangeRate[i]));
+static void updatePalette(Display* d, DisplayFrameStats* stats)
+{
+	TRACE_BEGIN(zone);
+	const Uint64 start = SDL_GetTicksNS();
+	if (cycleUpdatePalette(&d->cyc, &d->surf, d->cycleMethod, &d->dirtyRanges))
 		d->surfDamage = true;
-		break;
-	default: break;
+	stats->stageNs[DISPLAY_STAGE_PALETTE] += SDL_GetTicksNS() - start;
+	TRACE_END(zone, "updatePalette");
+}
+
+// Moves what the surface has done into the frame's stats
+static void takeSurfaceStats(DisplayFrameStats* stats, Surface* surf)
+{
+	stats->stageNs[DISPLAY_STAGE_COMBINE] += surf->stats.combineNs;
+	stats->stageNs[DISPLAY_STAGE_UPLOAD]  += surf->stats.uploadNs;
+	stats->pixels += surf->stats.pixels;
+	stats->bytes  += surf->stats.bytes;
+	surf->stats = (SurfaceStats){ 0, 0, 0, 0 };
+}
+
+static void finishFrameStats(Display* d)
+{
+	d->lastStats = d->stats;
+	d->stats = (DisplayFrameStats){ .pixels = 0 };
+	++d->numFrames;
+}
+
+
+// Runs & tiles combine deltas against the previous frame in the same memory, so alternating
+//  buffers are only kept current by span combines, which cover every cycling pixel each time
+static bool pipelineUsable(const Display* d)
+{
+	// Step mode changes too rarely to gain from running a frame ahead
+	// Software rendering is better served by drawing into the window directly
+	return d->wantPipelined && d->hasAnim && !d->indexed && d->surfTex && !d->softDirect
+		&& d->cycleMethod != DISPLAY_CYCLEMETHOD_STEP
+		&& d->surf.spans && d->surf.spanBeg >= 0
+		&& SDL_GetNumLogicalCPUCores() > 1;
+}
+
+static int SDLCALL pipelineMain(void* data)
+{
+	Display* d = data;
+	Surface* surf = &d->surf;
+	int back = 0;
+	TRACE_THREAD("frames");
+	while (true)
+	{
+		SDL_WaitSemaphore(d->pipeRequest);
+		if (d->pipeQuit)
+			break;
+
+		DisplayFrameStats* stats = &d->pipeStats[back];
+		(*stats) = (DisplayFrameStats){ .pixels = 0 };
+		surf->stats = (SurfaceStats){ 0, 0, 0, 0 };
+		cycleSeek(&d->cyc, d->pipeReqClock);
+		updatePalette(d, stats);
+
+		// Each buffer gets one full combine, only the spans can change after that
+		TRACE_BEGIN(zone);
+		const Uint64 start = SDL_GetTicksNS();
+		surf->dst = d->pipeFrames[back];
+		surf->dstStride = (size_t)surf->w;
+		surf->dstX = surf->dstY = 0;
+		if (d->pipeFresh[back])
+		{
+			surfaceCombine(surf);
+			d->pipeFresh[back] = false;
+		}
+		else
+		{
+			surfaceCombinePartial(surf, d->pool);
+		}
+		surf->dst = NULL;
+		stats->stageNs[DISPLAY_STAGE_COMBINE] = SDL_GetTicksNS() - start;
+		stats->pixels = surf->stats.pixels;
+		TRACE_END(zone, "surfaceCombine");
+
+		SDL_SetAtomicInt(&d->pipeReady, back);
+		SDL_SignalSemaphore(d->pipeDone);
+		back ^= 1;
+	}
+	return 0;
+}
+
+static void requestFrame(Display* d)
+{
+	d->pipeReqClock = d->clock;
+	d->pipePending = true;
+	SDL_SignalSemaphore(d->pipeRequest);
+}
+
+static int waitFrame(Display* d)
+{
+	TRACE_BEGIN(zone);
+	SDL_WaitSemaphore(d->pipeDone);
+	TRACE_END(zone, "waitFrame");
+	return SDL_GetAtomicInt(&d->pipeReady);
+}
+
+static void startPipeline(Display* d)
+{
+	if (d->pipelined || !pipelineUsable(d))
+		return;
+
+	if (!d->pipeThread)
+	{
+		if (!d->pipeRequest && !(d->pipeRequest = SDL_CreateSemaphore(0)))
+			return;
+		if (!d->pipeDone && !(d->pipeDone = SDL_CreateSemaphore(0)))
+			return;
+		d->pipeThread = SDL_CreateThread(pipelineMain, "frames", d);
+		if (!d->pipeThread)
+			return;
+	}
+	for (unsigned i = 0; i < 2; ++i)
+	{
+		if (d->pipeFrames[i])
+			continue;
+		d->pipeFrames[i] = malloc(d->surf.w * (size_t)d->surf.h * sizeof(Colour));
+		if (!d->pipeFrames[i])
+			return;
+		d->pipeFresh[i] = true;
 	}
+
+	SDL_memcpy(d->shownPal, d->surf.pal, sizeof(d->shownPal));
+	SDL_SetAtomicInt(&d->pipeReady, -1);
+	d->pipeUploadWhole = true;
+	d->pipelined = true;
+	requestFrame(d);
+}
+
+static void stopPipeline(Display* d)
+{
+	if (!d->pipelined)
+		return;
+
+	// Let the frame in flight finish, its clock & palette carry over but the picture is dropped
+	if (d->pipePending)
+		waitFrame(d);
+	SDL_SetAtomicInt(&d->pipeReady, -1);
+	d->pipePending = false;
+	d->pipelined = false;
+	cycleSeek(&d->cyc, d->clock);
+
+	// The texture is at least a frame behind the palette now
+	d->surf.combFull = true;
+	d->surfDamage = true;
+	d->repaint = true;
+}
+
+static void consumeFrame(Display* d)
+{
+	// A late frame means presenting the last one again rather than holding up the present,
+	//  except for the first which the texture has nothing to show in place of
+	const int front = d->pipeUploadWhole ? waitFrame(d)
+		: SDL_TryWaitSemaphore(d->pipeDone) ? SDL_GetAtomicInt(&d->pipeReady) : -1;
+	if (front < 0)
+		return;
+	SDL_SetAtomicInt(&d->pipeReady, -1);
+	SDL_memcpy(d->shownPal, d->surf.pal, sizeof(d->shownPal));
+
+	// Start on the next frame straight away so it overlaps with uploading & presenting this one
+	requestFrame(d);
+
+	const DisplayFrameStats* made = &d->pipeStats[front];
+	d->stats.stageNs[DISPLAY_STAGE_PALETTE] += made->stageNs[DISPLAY_STAGE_PALETTE];
+	d->stats.stageNs[DISPLAY_STAGE_COMBINE] += made->stageNs[DISPLAY_STAGE_COMBINE];
+	d->stats.pixels += made->pixels;
+
+	const Uint64 start = SDL_GetTicksNS();
+	const Surface* surf = &d->surf;
+	const Colour* frame = d->pipeFrames[front];
+	const int pitch = surf->w * (int)sizeof(Colour);
+	if (d->pipeUploadWhole)
+	{
+		SDL_UpdateTexture(d->surfTex, NULL, frame, pitch);
+		d->stats.bytes += sizeof(Colour) * (uint64_t)surf->w * (uint64_t)surf->h;
+		d->pipeUploadWhole = false;
+	}
+	else
+	{
+		for (int i = 0; i < surf->numDirty; ++i)
+		{
+			const SurfRect* r = &surf->dirty[i];
+			const SDL_Rect rect = { r->x, r->y, r->w, r->h };
+			SDL_UpdateTexture(d->surfTex, &rect, &frame[(size_t)r->y * surf->w + r->x], pitch);
+			d->stats.bytes += sizeof(Colour) * (uint64_t)r->w * (uint64_t)r->h;
+		}
+	}
+	d->stats.stageNs[DISPLAY_STAGE_UPLOAD] += SDL_GetTicksNS() - start;
+}
+
+static bool canRepaintDirect(const Display* d)
+{
+	// Anything drawn over the picture goes through the renderer
+	return d->softDirect && !d->indexed && d->surf.spans && d->surf.spanBeg >= 0
+		&& !d->spanView && !d->palView && !displayIsTextShown(d);
+}
+
+// The software renderer would rescale the whole texture into the window surface every frame,
+//  instead scale just the spans into it & only present the rects they cover
+static int repaintDirect(Display* d)
+{
+	SDL_Window* win = SDL_GetRenderWindow(d->rend);
+	SDL_Surface* winSurf = win ? SDL_GetWindowSurface(win) : NULL;
+	// Same byte order as the surface texture, anything else goes through the renderer
+	if (!winSurf || winSurf->w != d->scrW || winSurf->h != d->scrH
+		|| (winSurf->format != SDL_PIXELFORMAT_BGRA32 && winSurf->format != SDL_PIXELFORMAT_BGRX32))
+		return -1;
+
+	const SDL_Rect rect = { (int)d->surfRect.x, (int)d->surfRect.y, (int)d->surfRect.w, (int)d->surfRect.h };
+	if (rect.w <= 0 || rect.h <= 0)
+		return -1;
+	if (!d->scaleMap && !(d->scaleMap = malloc(sizeof(int) * (size_t)(d->surf.w + d->surf.h + 2))))
+		return -1;
+	int* cols = d->scaleMap;
+	int* rows = d->scaleMap + d->surf.w + 1;
+	if (d->directFull || !SDL_RectsEqual(&rect, &d->scaleRect))
+	{
+		surfaceBuildScaleMap(cols, d->surf.w, rect.w);
+		surfaceBuildScaleMap(rows, d->surf.h, rect.h);
+		d->scaleRect = rect;
+		d->directFull = true;
+	}
+	if (!d->directFull && !d->surfDamage)
+		return 0;
+
+	// Whatever the renderer last presented is replaced wholesale so both scalers never meet
+	if (d->directFull)
+		SDL_FillSurfaceRect(winSurf, NULL, SDL_MapSurfaceRGB(winSurf, 0x00, 0x00, 0x00));
+	if (!SDL_LockSurface(winSurf))
+		return -1;
+	Surface* surf = &d->surf;
+	Uint64 start = SDL_GetTicksNS();
+	surf->dst = (Colour*)((uint8_t*)winSurf->pixels + (size_t)rect.y * (size_t)winSurf->pitch) + rect.x;
+	surf->dstStride = (size_t)winSurf->pitch / sizeof(Colour);
+	surf->dstX = surf->dstY = 0;
+	surfaceCombineScaled(surf, cols, rows, d->directFull, d->pool);
+	surf->dst = NULL;
+	SDL_UnlockSurface(winSurf);
+	const Uint64 now = SDL_GetTicksNS();
+	d->stats.stageNs[DISPLAY_STAGE_COMBINE] += now - start;
+	takeSurfaceStats(&d->stats, surf);
+	start = now;
+
+	TRACE_BEGIN(zone);
+	if (d->directFull)
+	{
+		SDL_UpdateWindowSurface(win);
+	}
+	else
+	{
+		SDL_Rect dirty[SURFACE_MAX_DIRTY];
+		int numDirty = 0;
+		for (int i = 0; i < surf->numDirty; ++i)
+		{
+			const SurfRect* r = &surf->dirty[i];
+			const SDL_Rect out = { rect.x + cols[r->x], rect.y + rows[r->y],
+				cols[r->x + r->w] - cols[r->x], rows[r->y + r->h] - rows[r->y] };
+			if (out.w > 0 && out.h > 0)
+				dirty[numDirty++] = out;
+		}
+		if (numDirty)
+			SDL_UpdateWindowSurfaceRects(win, dirty, numDirty);
+	}
+	TRACE_END(zone, "SDL_UpdateWindowSurface");
+
+	// Pace presents ourselves when the window surface can't wait for vblank, unless vsync was turned off
+	int vsync = 0, rendVsync = 1;
+	SDL_GetRenderVSync(d->rend, &rendVsync);
+	if (rendVsync && (!SDL_GetWindowSurfaceVSync(win, &vsync) || !vsync))
+	{
+		if (!d->directPeriod)
+		{
+			const SDL_DisplayMode* mode = SDL_GetCurrentDisplayMode(SDL_GetDisplayForWindow(win));
+			const double rate = mode && mode->refresh_rate > 0.0f ? (double)mode->refresh_rate : 60.0;
+			d->directPeriod = (Uint64)((double)SDL_NS_PER_SECOND / rate);
+		}
+		const Uint64 now = SDL_GetTicksNS();
+		if (now - d->directPresented < d->directPeriod)
+			SDL_DelayPrecise(d->directPeriod - (now - d->directPresented));
+		d->directPresented = SDL_GetTicksNS();
+	}
+	d->stats.stageNs[DISPLAY_STAGE_PRESENT] += SDL_GetTicksNS() - start;
+
+	// The texture is now behind, should the renderer take over again
+	surf->combFull = true;
+	d->surfDamage = false;
+	d->dirtyRanges = 0;
+	d->directFull = false;
+	return 0;
 }
 
 void displayRepaint(Display* d)
@@ -367,18 +907,53 @@ void displayRepaint(Display* d)
 	if (!d || !d->repaint)
 		return;
 
-	// Update palette
-	if (d->hasAnim)
-		updatePalette(d);
-
-	// Animate image with palette
-	if (d->surfDamage)
+	if (d->pipelined)
 	{
-		surfaceUpdate(&d->surf, d->surfTex);
-		d->surfDamage = false;
+		// Palette & combine already happened on the producer
+		consumeFrame(d);
+	}
+	else
+	{
+		// Update palette
+		if (d->hasAnim)
+			updatePalette(d, &d->stats);
+
+		// Headless frames end at the combine, see displayGetFrame()
+		if (!d->rend)
+		{
+			if (d->surfDamage)
+				surfaceUpdate(&d->surf, NULL, d->pool);
+			takeSurfaceStats(&d->stats, &d->surf);
+			finishFrameStats(d);
+			d->dirtyRanges = 0;
+			d->surfDamage = false;
+			d->repaint = false;
+			return;
+		}
+		if (canRepaintDirect(d) && !repaintDirect(d))
+		{
+			finishFrameStats(d);
+			d->repaint = false;
+			return;
+		}
+
+		// Animate image with palette
+		if (d->surfDamage)
+		{
+			if (d->indexed)
+				surfaceUpdatePalette(&d->surf, d->surfPal);
+			else if (d->cycleMethod == DISPLAY_CYCLEMETHOD_STEP && d->dirtyRanges)
+				surfaceUpdateTiles(&d->surf, d->surfTex, d->pool, d->dirtyRanges);
+			else
+				surfaceUpdate(&d->surf, d->surfTex, d->pool);
+			d->dirtyRanges = 0;
+			d->surfDamage = false;
+		}
+		takeSurfaceStats(&d->stats, &d->surf);
 	}
 
 	// Render everthing
+	const Uint64 start = SDL_GetTicksNS();
 	SDL_SetRenderDrawColor(d->rend, 0x00, 0x00, 0x00, 0xFF);
 	SDL_RenderClear(d->rend);
 	SDL_RenderTexture(d->rend, d->surfTex, NULL, &d->surfRect);
@@ -395,18 +970,38 @@ void displayRepaint(Display* d)
 			? (d->textTimer - TEXT_TIME_FADE) / (TEXT_TIME_END - TEXT_TIME_FADE) : 0.0f;
 		Uint8 alpha = (Uint8)((1.0f - interp) * 0xFF);
 		SDL_SetRenderDrawColor(d->rend, 0x00, 0x00, 0x00, alpha >> 1);
-		SDL_SetTextureAlphaMod(d->font.tex, alpha);
-		int w, h;
-		textComputeArea(d->textScale, &w, &h, d->text);
+		// Laid out only when the text or its scale changes, fading just rewrites vertex alpha
+		if (!d->textLayoutValid)
+			d->textLayoutValid = !textLayout(&d->textLayout, d->textScale, d->text);
 		const int margin = 1 + 5 * d->textScale;
-		h += margin;
+		const int h = d->textLayout.h + margin;
 		SDL_RenderFillRect(d->rend, &(SDL_FRect){0.f, (float)(d->scrH - h), (float)d->scrW, (float)h});
 		SDL_SetRenderDrawBlendMode(d->rend, SDL_BLENDMODE_NONE);
-		textDraw(&d->font, d->textScale, margin, d->scrH - h + (margin >> 1), d->text);
+		if (d->textLayoutValid)
+			textDrawLayout(&d->font, &d->textLayout, (float)margin, (float)(d->scrH - h + (margin >> 1)), (float)alpha / 255.f);
 	}
 
+	if (d->hud)
+	{
+		if (!d->hudLayoutValid)
+			d->hudLayoutValid = !textLayout(&d->hudLayout, d->textScale, d->hud);
+		const int margin = 1 + 5 * d->textScale;
+		SDL_SetRenderDrawBlendMode(d->rend, SDL_BLENDMODE_BLEND);
+		SDL_SetRenderDrawColor(d->rend, 0x00, 0x00, 0x00, 0xA0);
+		SDL_RenderFillRect(d->rend, &(SDL_FRect){ 0.f, 0.f,
+			(float)(d->hudLayout.w + margin), (float)(d->hudLayout.h + margin) });
+		SDL_SetRenderDrawBlendMode(d->rend, SDL_BLENDMODE_NONE);
+		if (d->hudLayoutValid)
+			textDrawLayout(&d->font, &d->hudLayout, (float)(margin >> 1), (float)(margin >> 1), 1.f);
+	}
+
+	TRACE_BEGIN(zone);
 	SDL_RenderPresent(d->rend);
+	TRACE_END(zone, "SDL_RenderPresent");
+	d->stats.stageNs[DISPLAY_STAGE_PRESENT] += SDL_GetTicksNS() - start;
+	finishFrameStats(d);
 	d->repaint = false;
+	d->directFull = true;
 }
 
 
@@ -430,12 +1025,47 @@ void displayCycleBlendMethod(Display* d)
 {
 	if (!d)
 		return;
-	d->cycleMethod = (d->cycleMethod + 1) % DISPLAY_CYCLEMETHOD_NUM;
-	if (d->cycleMethod == 0)
-		for (unsigned i = 0; i < d->numRange; ++i)
-			surfaceRange(&d->surf, d->rangeHigh[i], d->rangeLow[i], d->cyclePos[i]);
+	displaySetCycleMethod(d, (d->cycleMethod + 1) % DISPLAY_CYCLEMETHOD_NUM);
+}
+
+void displaySetCycleMethod(Display* d, int method)
+{
+	if (!d || method < 0 || method >= DISPLAY_CYCLEMETHOD_NUM)
+		return;
+	stopPipeline(d);
+	d->cycleMethod = method;
+	if (d->cycleMethod == DISPLAY_CYCLEMETHOD_STEP)
+	{
+		cycleResetPalette(&d->cyc, &d->surf);
+		d->dirtyRanges = UINT16_MAX;
+	}
 	d->surfDamage = true;
 	d->repaint = true;
+	startPipeline(d);
+}
+
+void displayToggleIndexed(Display* d)
+{
+	if (!d)
+		return;
+	stopPipeline(d);
+	d->wantIndexed = !d->wantIndexed;
+	if (createSurfaceTexture(d))
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Failed to recreate surface texture: %s", SDL_GetError());
+	d->repaint = true;
+	startPipeline(d);
+}
+
+void displayTogglePipelined(Display* d)
+{
+	if (!d)
+		return;
+	d->wantPipelined = !d->wantPipelined;
+	if (d->wantPipelined)
+		startPipeline(d);
+	else
+		stopPipeline(d);
+	d->repaint = true;
 }
 
 
@@ -449,6 +1079,61 @@ bool displayIsPaletteShown(const Display* d)
 	return d ? d->palView : false;
 }
 
+bool displayIsIndexedWanted(const Display* d)
+{
+	return d ? d->wantIndexed : false;
+}
+
+bool displayIsIndexed(const Display* d)
+{
+	return d ? d->indexed : false;
+}
+
+const Colour* displayGetFrame(const Display* d, int* w, int* h)
+{
+	if (!d || d->rend || !d->surf.comb)
+		return NULL;
+	if (w)
+		*w = d->surf.w;
+	if (h)
+		*h = d->surf.h;
+	return d->surf.comb;
+}
+
+const uint8_t* displayGetFrameIndexed(const Display* d, const Colour** pal, int* w, int* h)
+{
+	if (!d || d->rend || !d->surf.srcPix)
+		return NULL;
+	if (pal)
+		*pal = d->surf.pal;
+	if (w)
+		*w = d->surf.w;
+	if (h)
+		*h = d->surf.h;
+	return d->surf.srcPix;
+}
+
+const SurfRect* displayGetFrameDirty(const Display* d, int* num)
+{
+	if (num)
+		*num = 0;
+	if (!d || !d->surf.spans)
+		return NULL;
+	if (num)
+		*num = d->surf.numDirty;
+	return d->surf.dirty;
+}
+
+bool displayIsPipelineWanted(const Display* d)
+{
+	return d ? d->wantPipelined : false;
+}
+
+bool displayIsPipelined(const Display* d)
+{
+	return d ? d->pipelined : false;
+}
+
 int displayGetCycleMethod(const Display* d)
 {
 	return d ? d->cycleMethod : -1;
@@ -462,6 +1147,7 @@ void displayResize(Display* d, int w, int h)
 	d->srcAspect = (double)d->surf.w / (double)d->surf.h;
 	recalcDisplayRect(d, w, h, d->srcAspect);
 	d->repaint = true;
+	d->directFull = true;
 
 	d->scrW = w, d->scrH = h;
 }
@@ -470,13 +1156,19 @@ void displayContentScale(Display* d, double scale)
 {
 	if (!d)
 		return;
-	d->textScale = MAX(1, 1 + (int)(scale + 0.5));
+	const int textScale = MAX(1, 1 + (int)(scale + 0.5));
+	if (textScale != d->textScale)
+		d->textLayoutValid = d->hudLayoutValid = false;
+	d->textScale = textScale;
+	d->repaint = true;
 }
 
 void displayDamage(Display* d)
 {
-	if (d)
-		d->repaint = true;
+	if (!d)
+		return;
+	d->repaint = true;
+	d->directFull = true;
 }
 
 
@@ -486,4 +1178,24 @@ void displayShowText(Display* d, const char* text)
 		return;
 	d->text = text;
 	d->textTimer = 0;
+	d->textLayoutValid = false;
+	d->repaint = true;
+}
+
+void displayShowHud(Display* d, const char* text)
+{
+	if (!d)
+		return;
+	d->hud = text;
+	d->hudLayoutValid = false;
+	d->repaint = true;
+}
+
+const DisplayFrameStats* displayGetFrameStats(const Display* d, uint64_t* frames)
+{
+	if (!d)
+		return NULL;
+	if (frames)
+		*frames = d->numFrames;
+	return &d->lastStats;
 }
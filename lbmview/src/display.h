@@ -15,27 +15,69 @@ enum DisplayCycleMethod
 	DISPLAY_CYCLEMETHOD_LINEAR,
 	DISPLAY_CYCLEMETHOD_HSLUV,
 	DISPLAY_CYCLEMETHOD_LAB,
+	DISPLAY_CYCLEMETHOD_OKLAB,
+	DISPLAY_CYCLEMETHOD_OKLCH,
 
 	DISPLAY_CYCLEMETHOD_NUM
 };
 
-Display* displayInit(SDL_Renderer* renderer, const Lbm* lbm, const void* precompSpans, size_t precompSpansLen);
+enum DisplayStage
+{
+	DISPLAY_STAGE_SEEK = 0,
+	DISPLAY_STAGE_PALETTE,
+	DISPLAY_STAGE_COMBINE,
+	DISPLAY_STAGE_UPLOAD,
+	DISPLAY_STAGE_PRESENT,
+
+	DISPLAY_STAGE_NUM
+};
+
+// Where one frame's time went, pipelined frames include the producer's palette & combine
+typedef struct DisplayFrameStats
+{
+	uint64_t stageNs[DISPLAY_STAGE_NUM];
+	uint64_t pixels;  // Combined
+	uint64_t bytes;   // Uploaded
+} DisplayFrameStats;
+
+// A NULL renderer makes a headless display, which only combines frames into memory
+Display* displayInit(SDL_Renderer* renderer, const Lbm* lbm, const void* precompSpans, size_t precompSpansLen, int precompSpansVer);
 void displayFree(Display* d);
-int displayReset(Display* d, const Lbm* lbm, const void* precompSpans, size_t precompSpansLen);
+int displayReset(Display* d, const Lbm* lbm, const void* precompSpans, size_t precompSpansLen, int precompSpansVer);
 
 bool displayHasAnimation(const Display* d);
 bool displayIsTextShown(const Display* d);
 
 void displayRepaint(Display* d);
-void displayUpdateTimer(Display* d, double delta);
+// Moves the animation to t nanoseconds in at normal speed, the state follows from t alone
+//  so any point can be jumped to directly & the same t always gives the same picture
+void displaySeek(Display* d, uint64_t t);
 void displayUpdateTextDisplay(Display* d, double delta);
+// Seconds at normal speed until every range is back where it started, 0 if nothing cycles
+double displayLoopPeriod(const Display* d);
+// Seconds until the picture next changes at the given speed, 0 if every frame & INFINITY if never
+double displayTimeToNextChange(const Display* d, double timescale);
 
 void displayToggleShowSpan(Display* d);
 void displayToggleShowPalette(Display* d);
 void displayCycleBlendMethod(Display* d);
+void displaySetCycleMethod(Display* d, int method);
+void displayToggleIndexed(Display* d);
+// Build the next frame on a worker thread while the current one presents
+void displayTogglePipelined(Display* d);
 
 bool displayIsSpanShown(const Display* d);
 bool displayIsPaletteShown(const Display* d);
+bool displayIsIndexedWanted(const Display* d);
+bool displayIsIndexed(const Display* d);
+bool displayIsPipelineWanted(const Display* d);
+bool displayIsPipelined(const Display* d);
+// Headless only, the frame combined by the last displayRepaint() as w * h packed pixels
+const Colour* displayGetFrame(const Display* d, int* w, int* h);
+// Headless only, the source indices & current palette the frame is combined from
+const uint8_t* displayGetFrameIndexed(const Display* d, const Colour** pal, int* w, int* h);
+// Areas of the frame that can differ between repaints, NULL if any of it can
+const struct SurfRect* displayGetFrameDirty(const Display* d, int* num);
 int displayGetCycleMethod(const Display* d);
 
 void displayResize(Display* d, int w, int h);
@@ -43,5 +85,9 @@ void displayContentScale(Display* d, double scale);
 void displayDamage(Display* d);
 
 void displayShowText(Display* d, const char* text);
+// Kept in the top left until replaced or hidden with NULL, the text isn't copied
+void displayShowHud(Display* d, const char* text);
+// The last frame displayRepaint() drew, frames is how many it has drawn so far
+const DisplayFrameStats* displayGetFrameStats(const Display* d, uint64_t* frames);
 
 #endif//DISPLAY_H
@@ -0,0 +1,350 @@
+/* encode.c - (C) 2025 a dinosaur (zlib) */
+#include "encode.h"
+#include "util.h"
+#include <SDL3/SDL.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+
+int encodeReserve(EncodeBuf* buf, size_t len)
+{
+	if (buf->cap - buf->len >= len)
+		return 0;
+	size_t cap = MAX(buf->cap * 2, (size_t)4096);
+	while (cap - buf->len < len)
+		cap *= 2;
+	uint8_t* ptr = realloc(buf->ptr, cap);
+	if (!ptr)
+		return -1;
+	buf->ptr = ptr;
+	buf->cap = cap;
+	return 0;
+}
+
+int encodePut(EncodeBuf* buf, const void* data, size_t len)
+{
+	if (encodeReserve(buf, len))
+		return -1;
+	SDL_memcpy(&buf->ptr[buf->len], data, len);
+	buf->len += len;
+	return 0;
+}
+
+void encodeFree(EncodeBuf* buf)
+{
+	free(buf->ptr);
+	(*buf) = ENCODEBUF_CLEAR();
+}
+
+
+#define LZW_MAX_CODES 4096
+#define LZW_HASH_BITS 13
+#define LZW_HASH_MASK ((1U << LZW_HASH_BITS) - 1U)
+
+typedef struct
+{
+	EncodeBuf* buf;
+	uint8_t block[255];
+	int blockLen;
+	uint32_t bits;
+	int numBits;
+	int err;
+} LzwWriter;
+
+static void lzwFlushBlock(LzwWriter* w)
+{
+	if (!w->blockLen)
+		return;
+	const uint8_t len = (uint8_t)w->blockLen;
+	if (encodePut(w->buf, &len, 1) || encodePut(w->buf, w->block, (size_t)w->blockLen))
+		w->err = -1;
+	w->blockLen = 0;
+}
+
+static void lzwPut(LzwWriter* w, unsigned code, int size)
+{
+	w->bits |= (uint32_t)code << w->numBits;
+	w->numBits += size;
+	while (w->numBits >= 8)
+	{
+		w->block[w->blockLen++] = (uint8_t)w->bits;
+		w->bits >>= 8;
+		w->numBits -= 8;
+		if (w->blockLen == (int)sizeof(w->block))
+			lzwFlushBlock(w);
+	}
+}
+
+int encodeGifLzw(EncodeBuf* buf, const uint8_t* pix, size_t stride, int w, int h, int minCodeSize)
+{
+	if (!buf || !pix || w <= 0 || h <= 0 || minCodeSize < 2 || minCodeSize > 8)
+		return -1;
+
+	// Open addressed dictionary of (prefix code, next index) pairs
+	int32_t* keys = malloc(sizeof(int32_t) << LZW_HASH_BITS);
+	uint16_t* codes = malloc(sizeof(uint16_t) << LZW_HASH_BITS);
+	const uint8_t codeSizeByte = (uint8_t)minCodeSize;
+	if (!keys || !codes || encodePut(buf, &codeSizeByte, 1))
+	{
+		free(codes);
+		free(keys);
+		return -1;
+	}
+	SDL_memset(keys, 0xFF, sizeof(int32_t) << LZW_HASH_BITS);
+
+	LzwWriter lw = { .buf = buf, .blockLen = 0, .bits = 0, .numBits = 0, .err = 0 };
+	const unsigned clear = 1U << minCodeSize;
+	unsigned next = clear + 2;
+	int size = minCodeSize + 1;
+	lzwPut(&lw, clear, size);
+
+	int prefix = -1;
+	for (int j = 0; j < h; ++j)
+	{
+		const uint8_t* row = &pix[(size_t)j * stride];
+		for (int i = 0; i < w; ++i)
+		{
+			if (prefix < 0)
+			{
+				prefix = row[i];
+				continue;
+			}
+			const int32_t key = prefix << 8 | row[i];
+			unsigned slot = ((uint32_t)key * 0x9E3779B1U) >> (32 - LZW_HASH_BITS);
+			while (keys[slot] >= 0 && keys[slot] != key)
+				slot = (slot + 1U) & LZW_HASH_MASK;
+			if (keys[slot] == key)
+			{
+				prefix = codes[slot];
+				continue;
+			}
+
+			lzwPut(&lw, (unsigned)prefix, size);
+			keys[slot] = key;
+			codes[slot] = (uint16_t)next++;
+			if (next > (1U << size) && size < 12)
+				++size;
+			if (next == LZW_MAX_CODES)
+			{
+				// Table's full, start over rather than keep coding with stale strings
+				lzwPut(&lw, clear, size);
+				SDL_memset(keys, 0xFF, sizeof(int32_t) << LZW_HASH_BITS);
+				next = clear + 2;
+				size = minCodeSize + 1;
+			}
+			prefix = row[i];
+		}
+	}
+
+	// Decoders add the entry this code completes as they read it, so they may widen before the clear,
+	//  which resets them to the starting width for the end code
+	lzwPut(&lw, (unsigned)prefix, size);
+	if (next >= (1U << size) && size < 12)
+		++size;
+	lzwPut(&lw, clear, size);
+	lzwPut(&lw, clear + 1, minCodeSize + 1);
+	if (lw.numBits > 0)
+		lzwPut(&lw, 0, 8 - lw.numBits);
+	lzwFlushBlock(&lw);
+
+	free(codes);
+	free(keys);
+	const uint8_t terminator = 0;
+	if (lw.err || encodePut(buf, &terminator, 1))
+		return -1;
+	return 0;
+}
+
+
+#define DEFLATE_WINDOW    32768
+#define DEFLATE_HASH_BITS 15
+#define DEFLATE_MIN_MATCH 3
+#define DEFLATE_MAX_MATCH 258
+#define DEFLATE_MAX_CHAIN 32
+
+static const uint16_t lengthBase[29] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t lengthExtra[29] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+	3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t distBase[30] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const uint8_t distExtra[30] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+	7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+typedef struct
+{
+	uint8_t* out;
+	uint64_t bits;
+	int numBits;
+} BitWriter;
+
+static inline void FORCE_INLINE putBits(BitWriter* w, uint32_t v, int n)
+{
+	w->bits |= (uint64_t)v << w->numBits;
+	w->numBits += n;
+	while (w->numBits >= 8)
+	{
+		*w->out++ = (uint8_t)w->bits;
+		w->bits >>= 8;
+		w->numBits -= 8;
+	}
+}
+
+static uint32_t reverseBits(uint32_t v, int n)
+{
+	uint32_t r = 0;
+	for (int i = 0; i < n; ++i, v >>= 1)
+		r = r << 1 | (v & 0x1);
+	return r;
+}
+
+// Huffman codes go out most significant bit first, so they're stored pre-reversed
+static void putFixedLiteral(BitWriter* w, unsigned sym)
+{
+	if (sym < 144)
+		putBits(w, reverseBits(0x30 + sym, 8), 8);
+	else if (sym < 256)
+		putBits(w, reverseBits(0x190 + sym - 144, 9), 9);
+	else if (sym < 280)
+		putBits(w, reverseBits(sym - 256, 7), 7);
+	else
+		putBits(w, reverseBits(0xC0 + sym - 280, 8), 8);
+}
+
+static void putMatch(BitWriter* w, int len, int dist)
+{
+	unsigned l = 28;
+	while (lengthBase[l] > len)
+		--l;
+	putFixedLiteral(w, 257 + l);
+	putBits(w, (uint32_t)(len - lengthBase[l]), lengthExtra[l]);
+	unsigned d = 29;
+	while (distBase[d] > dist)
+		--d;
+	putBits(w, reverseBits(d, 5), 5);
+	putBits(w, (uint32_t)(dist - distBase[d]), distExtra[d]);
+}
+
+static inline unsigned FORCE_INLINE hash3(const uint8_t* p)
+{
+	return ((uint32_t)p[0] << 16 | (uint32_t)p[1] << 8 | p[2]) * 0x9E3779B1U >> (32 - DEFLATE_HASH_BITS);
+}
+
+int encodeZlib(EncodeBuf* buf, const uint8_t* data, size_t len)
+{
+	// Fixed codes are at most 9 bits per literal, matches only ever save space
+	if (!buf || (!data && len) || encodeReserve(buf, len + len / 8 + 16))
+		return -1;
+	int32_t* head = malloc(sizeof(int32_t) << DEFLATE_HASH_BITS);
+	int32_t* prev = malloc(sizeof(int32_t) * DEFLATE_WINDOW);
+	if (!head || !prev)
+	{
+		free(prev);
+		free(head);
+		return -1;
+	}
+	SDL_memset(head, 0xFF, sizeof(int32_t) << DEFLATE_HASH_BITS);
+
+	BitWriter w = { .out = &buf->ptr[buf->len], .bits = 0, .numBits = 0 };
+	putBits(&w, 0x78, 8);
+	putBits(&w, 0x01, 8);
+	putBits(&w, 1, 1);  // Final block
+	putBits(&w, 1, 2);  // Fixed Huffman codes
+
+	size_t i = 0;
+	while (i < len)
+	{
+		int best = 0, bestDist = 0;
+		if (i + DEFLATE_MIN_MATCH <= len)
+		{
+			const unsigned h = hash3(&data[i]);
+			const int maxLen = (int)MIN(len - i, (size_t)DEFLATE_MAX_MATCH);
+			int32_t cand = head[h];
+			for (int chain = DEFLATE_MAX_CHAIN; cand >= 0 && i - (size_t)cand <= DEFLATE_WINDOW && chain > 0; --chain)
+			{
+				const uint8_t* a = &data[cand], * b = &data[i];
+				if (a[best] == b[best])
+				{
+					int l = 0;
+					while (l < maxLen && a[l] == b[l])
+						++l;
+					if (l > best)
+					{
+						best = l;
+						bestDist = (int)(i - (size_t)cand);
+						if (l == maxLen)
+							break;
+					}
+				}
+				cand = prev[cand & (DEFLATE_WINDOW - 1)];
+			}
+		}
+
+		const size_t step = best >= DEFLATE_MIN_MATCH ? (size_t)best : 1;
+		if (step > 1)
+			putMatch(&w, best, bestDist);
+		else
+			putFixedLiteral(&w, data[i]);
+		for (const size_t end = i + step; i < end; ++i)
+		{
+			if (i + DEFLATE_MIN_MATCH > len)
+				continue;
+			const unsigned h = hash3(&data[i]);
+			prev[i & (DEFLATE_WINDOW - 1)] = head[h];
+			head[h] = (int32_t)i;
+		}
+	}
+	putFixedLiteral(&w, 256);
+	if (w.numBits > 0)
+		putBits(&w, 0, 8 - w.numBits);
+
+	uint32_t s1 = 1, s2 = 0;
+	for (size_t k = 0; k < len; k += 5552)
+	{
+		// Largest run before s2 can overflow
+		for (size_t n = k; n < MIN(len, k + 5552); ++n)
+		{
+			s1 += data[n];
+			s2 += s1;
+		}
+		s1 %= 65521U;
+		s2 %= 65521U;
+	}
+	putBits(&w, s2 >> 8, 8);
+	putBits(&w, s2 & 0xFF, 8);
+	putBits(&w, s1 >> 8, 8);
+	putBits(&w, s1 & 0xFF, 8);
+
+	buf->len = (size_t)(w.out - buf->ptr);
+	free(prev);
+	free(head);
+	return 0;
+}
+
+
+uint32_t encodeCrc32(uint32_t crc, const void* data, size_t len)
+{
+	static uint32_t table[256];
+	static bool tableInit = false;
+	if (!tableInit)
+	{
+		for (uint32_t i = 0; i < 256; ++i)
+		{
+			uint32_t c = i;
+			for (unsigned k = 0; k < 8; ++k)
+				c = c & 0x1 ? 0xEDB88320U ^ (c >> 1) : c >> 1;
+			table[i] = c;
+		}
+		tableInit = true;
+	}
+
+	const uint8_t* p = data;
+	crc = ~crc;
+	for (size_t i = 0; i < len; ++i)
+		crc = table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+	return ~crc;
+}
@@ -0,0 +1,22 @@
+#ifndef ENCODE_H
+#define ENCODE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct { uint8_t* ptr; size_t len, cap; } EncodeBuf;
+
+#define ENCODEBUF_CLEAR() (EncodeBuf){ NULL, 0U, 0U }
+
+int encodeReserve(EncodeBuf* buf, size_t len);
+int encodePut(EncodeBuf* buf, const void* data, size_t len);
+void encodeFree(EncodeBuf* buf);
+
+// GIF image data, the minimum code size byte then LZW codes in sub-blocks up to the terminator
+int encodeGifLzw(EncodeBuf* buf, const uint8_t* pix, size_t stride, int w, int h, int minCodeSize);
+// zlib stream of fixed Huffman deflate, as used by PNG
+int encodeZlib(EncodeBuf* buf, const uint8_t* data, size_t len);
+
+uint32_t encodeCrc32(uint32_t crc, const void* data, size_t len);
+
+#endif//ENCODE_H
@@ -0,0 +1,598 @@
+/* export.c - (C) 2025 a dinosaur (zlib) */
+#include "export.h"
+#include "encode.h"
+#include "util.h"
+#include "trace.h"
+#include <SDL3/SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#ifdef _WIN32
+# include <io.h>
+# include <fcntl.h>
+#endif
+
+
+#define Y4M_FRAME_TAG "FRAME\n"
+#define Y4M_FRAME_TAG_LEN (sizeof(Y4M_FRAME_TAG) - 1)
+
+// GIF delays under 2 centiseconds get clamped up to 10 by most decoders
+#define GIF_MIN_DELAY 2
+
+static const uint8_t pngSignature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+struct Exporter
+{
+	FILE* file;
+	int format;
+	int w, h, fps;
+
+	// Frames are converted into one buffer while the writer thread drains the other
+	uint8_t* bufs[2];
+	bool fresh[2];
+	size_t frameSize;
+	int back;
+
+	SDL_Thread* thread;
+	SDL_Semaphore* emptied;
+	SDL_Semaphore* filled;
+	SDL_AtomicInt failed;
+	bool quit;
+
+	// Indexed formats store one index image & hold each palette back until a different one
+	//  arrives, so that repeated states merge into a single longer frame
+	uint8_t* pix;
+	int tableBits;
+	SurfRect rect;
+	Colour pendPal[LBM_PAL_SIZE];
+	int frame, pendStart;
+	bool pending;
+	unsigned numWritten;
+	EncodeBuf lzw;  // The GIF sub-rectangle never changes, so it's only compressed once
+	EncodeBuf scratch, chunk;
+	uint32_t apngSeq;
+	long actlOfs;
+};
+
+static bool isIndexed(int format)
+{
+	return format == EXPORT_FORMAT_GIF || format == EXPORT_FORMAT_APNG;
+}
+
+static int SDLCALL writerMain(void* data)
+{
+	Exporter* e = data;
+	int front = 0;
+	TRACE_THREAD("export");
+	while (true)
+	{
+		SDL_WaitSemaphore(e->filled);
+		if (e->quit)
+			break;
+		if (fwrite(e->bufs[front], e->frameSize, 1, e->file) != 1)
+			SDL_SetAtomicInt(&e->failed, 1);
+		front ^= 1;
+		SDL_SignalSemaphore(e->emptied);
+	}
+	return 0;
+}
+
+static void freeExporter(Exporter* e)
+{
+	if (e->file && e->file != stdout)
+		fclose(e->file);
+	else if (e->file)
+		fflush(e->file);
+	SDL_DestroySemaphore(e->filled);
+	SDL_DestroySemaphore(e->emptied);
+	free(e->bufs[0]);
+	free(e->bufs[1]);
+	free(e->pix);
+	encodeFree(&e->lzw);
+	encodeFree(&e->scratch);
+	encodeFree(&e->chunk);
+	SDL_free(e);
+}
+
+static void writeOut(Exporter* e, const void* data, size_t len)
+{
+	if (len && fwrite(data, len, 1, e->file) != 1)
+		SDL_SetAtomicInt(&e->failed, 1);
+}
+
+static void putBe32(uint8_t* p, uint32_t v)
+{
+	p[0] = (uint8_t)(v >> 24);
+	p[1] = (uint8_t)(v >> 16);
+	p[2] = (uint8_t)(v >> 8);
+	p[3] = (uint8_t)v;
+}
+
+static void writePngChunk(Exporter* e, const char type[4], const void* data, size_t len)
+{
+	uint8_t head[8], tail[4];
+	putBe32(head, (uint32_t)len);
+	SDL_memcpy(&head[4], type, 4);
+	putBe32(tail, encodeCrc32(encodeCrc32(0, type, 4), data, len));
+	writeOut(e, head, sizeof(head));
+	writeOut(e, data, len);
+	writeOut(e, tail, sizeof(tail));
+}
+
+static void writeApngControl(Exporter* e, uint32_t numFrames)
+{
+	uint8_t control[8];
+	putBe32(control, numFrames);
+	putBe32(&control[4], 0);  // Loop forever
+	writePngChunk(e, "acTL", control, sizeof(control));
+}
+
+static int openIndexed(Exporter* e)
+{
+	if (e->format != EXPORT_FORMAT_APNG)
+		return 0;
+
+	uint8_t header[13];
+	putBe32(header, (uint32_t)e->w);
+	putBe32(&header[4], (uint32_t)e->h);
+	header[8] = 8;   // Bit depth
+	header[9] = 2;   // Truecolour, APNG can't swap palettes between frames
+	header[10] = 0;  // Deflate
+	header[11] = 0;  // Adaptive filtering
+	header[12] = 0;  // Not interlaced
+	writeOut(e, pngSignature, sizeof(pngSignature));
+	writePngChunk(e, "IHDR", header, sizeof(header));
+
+	// The frame count isn't known until the end, it's filled in by exportClose()
+	e->actlOfs = ftell(e->file);
+	if (e->actlOfs < 0)
+		return -1;
+	writeApngControl(e, 0);
+	return SDL_GetAtomicInt(&e->failed) ? -1 : 0;
+}
+
+static int closeIndexed(Exporter* e);
+
+Exporter* exportOpen(const char* path, int format, int w, int h, int fps)
+{
+	if (!path || format < 0 || format >= EXPORT_FORMAT_NUM || w <= 0 || h <= 0 || fps <= 0)
+		return NULL;
+	// Both store dimensions & timing in 16 bits, and APNG has to seek back to finish its header
+	if (isIndexed(format) && (w > UINT16_MAX || h > UINT16_MAX || fps > UINT16_MAX))
+		return NULL;
+	if (format == EXPORT_FORMAT_APNG && !SDL_strcmp(path, "-"))
+		return NULL;
+
+	Exporter* e = SDL_malloc(sizeof(Exporter));
+	if (!e)
+		return NULL;
+	(*e) = (Exporter)
+	{
+		.file = NULL,
+		.format = format,
+		.w = w, .h = h, .fps = fps,
+		.bufs = { NULL, NULL },
+		.fresh = { true, true },
+		.frameSize = format == EXPORT_FORMAT_Y4M
+			? Y4M_FRAME_TAG_LEN + (size_t)w * (size_t)h * 3
+			: (size_t)w * (size_t)h * sizeof(Colour),
+		.back = 0,
+		.thread = NULL,
+		.emptied = NULL,
+		.filled = NULL,
+		.quit = false,
+
+		.pix = NULL,
+		.tableBits = 8,
+		.rect = { 0, 0, 0, 0 },
+		.frame = 0, .pendStart = 0,
+		.pending = false,
+		.numWritten = 0,
+		.lzw = ENCODEBUF_CLEAR(),
+		.scratch = ENCODEBUF_CLEAR(),
+		.chunk = ENCODEBUF_CLEAR(),
+		.apngSeq = 0,
+		.actlOfs = 0
+	};
+	SDL_SetAtomicInt(&e->failed, 0);
+
+	if (!SDL_strcmp(path, "-"))
+	{
+#ifdef _WIN32
+		_setmode(_fileno(stdout), _O_BINARY);
+#endif
+		e->file = stdout;
+	}
+	else
+	{
+		e->file = fopen(path, "wb");
+	}
+	if (!e->file)
+	{
+		freeExporter(e);
+		return NULL;
+	}
+
+	// Indexed formats are cheap enough per frame to write as they come
+	if (isIndexed(format))
+	{
+		if (openIndexed(e))
+		{
+			freeExporter(e);
+			return NULL;
+		}
+		return e;
+	}
+
+	e->emptied = SDL_CreateSemaphore(2);
+	e->filled = SDL_CreateSemaphore(0);
+	e->bufs[0] = malloc(e->frameSize);
+	e->bufs[1] = malloc(e->frameSize);
+	if (!e->emptied || !e->filled || !e->bufs[0] || !e->bufs[1])
+	{
+		freeExporter(e);
+		return NULL;
+	}
+
+	if (format == EXPORT_FORMAT_Y4M)
+	{
+		for (unsigned i = 0; i < 2; ++i)
+			SDL_memcpy(e->bufs[i], Y4M_FRAME_TAG, Y4M_FRAME_TAG_LEN);
+		if (fprintf(e->file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444 XCOLORRANGE=LIMITED\n", w, h, fps) < 0)
+		{
+			freeExporter(e);
+			return NULL;
+		}
+	}
+
+	e->thread = SDL_CreateThread(writerMain, "export", e);
+	if (!e->thread)
+	{
+		freeExporter(e);
+		return NULL;
+	}
+	return e;
+}
+
+int exportClose(Exporter* e)
+{
+	if (!e)
+		return -1;
+
+	int res = 0;
+	if (isIndexed(e->format))
+	{
+		res = closeIndexed(e);
+	}
+	else
+	{
+		// Both buffers coming back means everything queued has been written
+		for (unsigned i = 0; i < 2; ++i)
+			SDL_WaitSemaphore(e->emptied);
+		e->quit = true;
+		SDL_SignalSemaphore(e->filled);
+		SDL_WaitThread(e->thread, NULL);
+	}
+
+	if (SDL_GetAtomicInt(&e->failed))
+		res = -1;
+	if (e->file != stdout && fclose(e->file))
+		res = -1;
+	else if (e->file == stdout && fflush(e->file))
+		res = -1;
+	e->file = NULL;
+	freeExporter(e);
+	return res;
+}
+
+bool exportIsIndexed(const Exporter* e)
+{
+	return e ? isIndexed(e->format) : false;
+}
+
+
+static void convertBgra(uint8_t* dst, const Colour* src, size_t len)
+{
+#if SDL_BYTEORDER == SDL_LIL_ENDIAN
+	SDL_memcpy(dst, src, len * sizeof(Colour));
+#else
+	for (size_t i = 0; i < len; ++i)
+	{
+		const Colour c = SDL_Swap32LE(src[i]);
+		SDL_memcpy(&dst[i * sizeof(Colour)], &c, sizeof(Colour));
+	}
+#endif
+}
+
+// BT.601 studio swing, 8-bit fixed point
+static void convertYuv(uint8_t* restrict y, uint8_t* restrict u, uint8_t* restrict v, const Colour* restrict src, size_t len)
+{
+	for (size_t i = 0; i < len; ++i)
+	{
+		const int r = COLOUR_R(src[i]), g = COLOUR_G(src[i]), b = COLOUR_B(src[i]);
+		y[i] = (uint8_t)(( 66 * r + 129 * g +  25 * b + 0x1080) >> 8);
+		u[i] = (uint8_t)((-38 * r -  74 * g + 112 * b + 0x8080) >> 8);
+		v[i] = (uint8_t)((112 * r -  94 * g -  18 * b + 0x8080) >> 8);
+	}
+}
+
+static void convertRect(Exporter* e, uint8_t* buf, const Colour* pixels, SurfRect rect)
+{
+	const size_t plane = (size_t)e->w * (size_t)e->h;
+	for (int j = rect.y; j < rect.y + rect.h; ++j)
+	{
+		const size_t ofs = (size_t)j * (size_t)e->w + (size_t)rect.x;
+		if (e->format == EXPORT_FORMAT_Y4M)
+		{
+			uint8_t* y = buf + Y4M_FRAME_TAG_LEN + ofs;
+			convertYuv(y, y + plane, y + plane * 2, &pixels[ofs], (size_t)rect.w);
+		}
+		else
+		{
+			convertBgra(&buf[ofs * sizeof(Colour)], &pixels[ofs], (size_t)rect.w);
+		}
+	}
+}
+
+int exportFrame(Exporter* e, const Colour* pixels, const SurfRect* dirty, int numDirty)
+{
+	if (!e || isIndexed(e->format) || !pixels || SDL_GetAtomicInt(&e->failed))
+		return -1;
+
+	SDL_WaitSemaphore(e->emptied);
+
+	// Each buffer still holds the frame before last, so only what may have changed needs converting
+	uint8_t* buf = e->bufs[e->back];
+	if (e->fresh[e->back] || !dirty)
+	{
+		convertRect(e, buf, pixels, (SurfRect){ 0, 0, e->w, e->h });
+		e->fresh[e->back] = false;
+	}
+	else
+	{
+		for (int i = 0; i < numDirty; ++i)
+			convertRect(e, buf, pixels, dirty[i]);
+	}
+
+	SDL_SignalSemaphore(e->filled);
+	e->back ^= 1;
+	return 0;
+}
+
+
+static int putLe16(EncodeBuf* buf, int v)
+{
+	const uint8_t b[2] = { (uint8_t)v, (uint8_t)(v >> 8) };
+	return encodePut(buf, b, sizeof(b));
+}
+
+static int putRgbTable(EncodeBuf* buf, const Colour* pal, int len)
+{
+	if (encodeReserve(buf, (size_t)len * 3))
+		return -1;
+	uint8_t* p = &buf->ptr[buf->len];
+	for (int i = 0; i < len; ++i, p += 3)
+	{
+		p[0] = (uint8_t)COLOUR_R(pal[i]);
+		p[1] = (uint8_t)COLOUR_G(pal[i]);
+		p[2] = (uint8_t)COLOUR_B(pal[i]);
+	}
+	buf->len += (size_t)len * 3;
+	return 0;
+}
+
+static int gifDelay(const Exporter* e, int start, int end)
+{
+	// Rounding both ends in centiseconds keeps the error from adding up over a long run
+	const int64_t fps = e->fps;
+	return (int)(((int64_t)end * 100 + fps / 2) / fps - ((int64_t)start * 100 + fps / 2) / fps);
+}
+
+static bool isTooLong(const Exporter* e, int start, int end)
+{
+	if (e->format == EXPORT_FORMAT_GIF)
+		return gifDelay(e, start, end) > UINT16_MAX;
+	return end - start > UINT16_MAX;
+}
+
+static int writeGifFrame(Exporter* e, int start, int end)
+{
+	EncodeBuf* b = &e->chunk;
+	b->len = 0;
+	const int tableLen = 1 << e->tableBits;
+	const int codeSize = MAX(2, e->tableBits);
+	const bool first = !e->numWritten;
+
+	// The first palette doubles as the global table
+	if (first)
+	{
+		static const uint8_t loop[19] = { 0x21, 0xFF, 0x0B,
+			'N', 'E', 'T', 'S', 'C', 'A', 'P', 'E', '2', '.', '0', 0x03, 0x01, 0x00, 0x00, 0x00 };
+		const uint8_t screen[3] = { (uint8_t)(0xF0 | (e->tableBits - 1)), 0, 0 };
+		if (encodePut(b, "GIF89a", 6) || putLe16(b, e->w) || putLe16(b, e->h)
+			|| encodePut(b, screen, sizeof(screen)) || putRgbTable(b, e->pendPal, tableLen)
+			|| encodePut(b, loop, sizeof(loop)))
+			return -1;
+	}
+
+	// Frames are drawn over the last, so later ones only redraw the cycling rectangle
+	const uint8_t control[4] = { 0x21, 0xF9, 0x04, 1 << 2 };
+	const SurfRect r = first ? (SurfRect){ 0, 0, e->w, e->h } : e->rect;
+	const uint8_t separator = 0x2C;
+	if (encodePut(b, control, sizeof(control)) || putLe16(b, gifDelay(e, start, end)) || encodePut(b, "\0\0", 2)
+		|| encodePut(b, &separator, 1) || putLe16(b, r.x) || putLe16(b, r.y) || putLe16(b, r.w) || putLe16(b, r.h))
+		return -1;
+	if (first)
+	{
+		const uint8_t flags = 0;
+		if (encodePut(b, &flags, 1) || encodeGifLzw(b, e->pix, (size_t)e->w, e->w, e->h, codeSize))
+			return -1;
+	}
+	else
+	{
+		const uint8_t flags = (uint8_t)(0x80 | (e->tableBits - 1));
+		if (encodePut(b, &flags, 1) || putRgbTable(b, e->pendPal, tableLen))
+			return -1;
+		if (!e->lzw.len && encodeGifLzw(&e->lzw, &e->pix[(size_t)r.y * (size_t)e->w + (size_t)r.x],
+			(size_t)e->w, r.w, r.h, codeSize))
+			return -1;
+	}
+
+	writeOut(e, b->ptr, b->len);
+	if (!first)
+		writeOut(e, e->lzw.ptr, e->lzw.len);
+	return 0;
+}
+
+static int writeApngFrame(Exporter* e, int start, int end)
+{
+	const bool first = !e->numWritten;
+	const SurfRect r = first ? (SurfRect){ 0, 0, e->w, e->h } : e->rect;
+
+	uint8_t control[26];
+	putBe32(control, e->apngSeq++);
+	putBe32(&control[4], (uint32_t)r.w);
+	putBe32(&control[8], (uint32_t)r.h);
+	putBe32(&control[12], (uint32_t)r.x);
+	putBe32(&control[16], (uint32_t)r.y);
+	// Delay in exact frames at the export rate
+	control[20] = (uint8_t)((end - start) >> 8);
+	control[21] = (uint8_t)(end - start);
+	control[22] = (uint8_t)(e->fps >> 8);
+	control[23] = (uint8_t)e->fps;
+	control[24] = 0;  // Leave in place
+	control[25] = 0;  // Replace, not blend
+	writePngChunk(e, "fcTL", control, sizeof(control));
+
+	// Unfiltered rows, the runs in pixel art already suit LZ77 well
+	const size_t rowLen = 1 + (size_t)r.w * 3;
+	e->scratch.len = 0;
+	if (encodeReserve(&e->scratch, rowLen * (size_t)r.h))
+		return -1;
+	for (int j = 0; j < r.h; ++j)
+	{
+		uint8_t* dst = &e->scratch.ptr[rowLen * (size_t)j];
+		const uint8_t* src = &e->pix[(size_t)(r.y + j) * (size_t)e->w + (size_t)r.x];
+		*dst++ = 0;
+		for (int i = 0; i < r.w; ++i, dst += 3)
+		{
+			const Colour c = e->pendPal[src[i]];
+			dst[0] = (uint8_t)COLOUR_R(c);
+			dst[1] = (uint8_t)COLOUR_G(c);
+			dst[2] = (uint8_t)COLOUR_B(c);
+		}
+	}
+
+	e->chunk.len = 0;
+	if (!first)
+	{
+		uint8_t seq[4];
+		putBe32(seq, e->apngSeq++);
+		if (encodePut(&e->chunk, seq, sizeof(seq)))
+			return -1;
+	}
+	if (encodeZlib(&e->chunk, e->scratch.ptr, rowLen * (size_t)r.h))
+		return -1;
+	writePngChunk(e, first ? "IDAT" : "fdAT", e->chunk.ptr, e->chunk.len);
+	return 0;
+}
+
+static int flushPending(Exporter* e)
+{
+	if (!e->pending)
+		return 0;
+	const int res = e->format == EXPORT_FORMAT_GIF
+		? writeGifFrame(e, e->pendStart, e->frame)
+		: writeApngFrame(e, e->pendStart, e->frame);
+	if (res)
+		return -1;
+	++e->numWritten;
+	e->pending = false;
+	return SDL_GetAtomicInt(&e->failed) ? -1 : 0;
+}
+
+static int closeIndexed(Exporter* e)
+{
+	if (flushPending(e) || !e->numWritten)
+		return -1;
+
+	if (e->format == EXPORT_FORMAT_GIF)
+	{
+		const uint8_t trailer = 0x3B;
+		writeOut(e, &trailer, 1);
+	}
+	else
+	{
+		writePngChunk(e, "IEND", NULL, 0);
+		if (fseek(e->file, e->actlOfs, SEEK_SET))
+			return -1;
+		writeApngControl(e, e->numWritten);
+	}
+	return 0;
+}
+
+int exportIndexedFrame(Exporter* e, const uint8_t* pix, const Colour pal[], const SurfRect* dirty, int numDirty)
+{
+	if (!e || !isIndexed(e->format) || !pix || !pal || SDL_GetAtomicInt(&e->failed))
+		return -1;
+
+	// Only the palette is expected to change, so the image is kept from the first frame
+	if (!e->pix)
+	{
+		const size_t len = (size_t)e->w * (size_t)e->h;
+		if (!(e->pix = malloc(len)))
+			return -1;
+		SDL_memcpy(e->pix, pix, len);
+		uint8_t top = 0;
+		for (size_t i = 0; i < len; ++i)
+			top = MAX(top, pix[i]);
+		for (e->tableBits = 1; e->tableBits < 8 && (1 << e->tableBits) <= top; ++e->tableBits);
+	}
+
+	// Nothing outside the bounds of the dirty rects changes colour between frames
+	SurfRect rect = { 0, 0, e->w, e->h };
+	if (dirty && numDirty > 0)
+	{
+		int x0 = e->w, y0 = e->h, x1 = 0, y1 = 0;
+		for (int i = 0; i < numDirty; ++i)
+		{
+			x0 = MIN(x0, dirty[i].x);
+			y0 = MIN(y0, dirty[i].y);
+			x1 = MAX(x1, dirty[i].x + dirty[i].w);
+			y1 = MAX(y1, dirty[i].y + dirty[i].h);
+		}
+		rect = x1 > x0 && y1 > y0 ? (SurfRect){ x0, y0, x1 - x0, y1 - y0 } : (SurfRect){ 0, 0, 1, 1 };
+	}
+	else if (dirty)
+	{
+		rect = (SurfRect){ 0, 0, 1, 1 };
+	}
+	if (SDL_memcmp(&rect, &e->rect, sizeof(SurfRect)))
+	{
+		e->rect = rect;
+		e->lzw.len = 0;
+	}
+
+	const size_t palSize = sizeof(Colour) << e->tableBits;
+	const bool same = e->pending && !SDL_memcmp(e->pendPal, pal, palSize);
+	if (same && !isTooLong(e, e->pendStart, e->frame + 1))
+	{
+		// Repeats just lengthen the pending frame
+	}
+	else if (e->pending && !same && e->format == EXPORT_FORMAT_GIF
+		&& gifDelay(e, e->pendStart, e->frame) < GIF_MIN_DELAY)
+	{
+		// Too short for GIF to show, the newer palette takes its place
+		SDL_memcpy(e->pendPal, pal, palSize);
+	}
+	else
+	{
+		if (flushPending(e))
+			return -1;
+		SDL_memcpy(e->pendPal, pal, palSize);
+		e->pendStart = e->frame;
+		e->pending = true;
+	}
+	++e->frame;
+	return 0;
+}
@@ -0,0 +1,33 @@
+#ifndef EXPORT_H
+#define EXPORT_H
+
+#include "surface.h"
+#include <stdbool.h>
+
+typedef struct Exporter Exporter;
+
+enum ExportFormat
+{
+	EXPORT_FORMAT_BGRA = 0,  // Raw 8-bit BGRA frames back to back
+	EXPORT_FORMAT_Y4M,       // YUV4MPEG2, 4:4:4 BT.601 limited range
+	EXPORT_FORMAT_GIF,       // Animated GIF, one palette per frame over a fixed index image
+	EXPORT_FORMAT_APNG,      // Animated PNG, only the cycling rectangle after the first frame
+
+	EXPORT_FORMAT_NUM
+};
+
+// Writes to stdout when path is "-", except APNG which needs to seek
+Exporter* exportOpen(const char* path, int format, int w, int h, int fps);
+// Returns -1 once a write has failed
+int exportClose(Exporter* e);
+
+// Queues a frame for the writer thread, blocking only while both buffers are still being written,
+//  dirty rects cover everything that may have changed since the last frame (NULL for all of it)
+int exportFrame(Exporter* e, const Colour* pixels, const SurfRect* dirty, int numDirty);
+
+// GIF & APNG take frames as indices & a palette, the indices must be the same every frame,
+//  consecutive frames with the same palette merge into one
+bool exportIsIndexed(const Exporter* e);
+int exportIndexedFrame(Exporter* e, const uint8_t* pix, const Colour pal[], const SurfRect* dirty, int numDirty);
+
+#endif//EXPORT_H
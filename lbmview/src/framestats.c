@@ -0,0 +1,128 @@
+/* framestats.c - (C) 2025 a dinosaur (zlib) */
+#include "framestats.h"
+#include <SDL3/SDL_stdinc.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+
+int frameStatsInit(FrameStats* fs, int size)
+{
+	if (!fs || size <= 0)
+		return -1;
+	fs->frames = malloc(sizeof(DisplayFrameStats) * (size_t)size);
+	if (!fs->frames)
+		return -1;
+	fs->size = size;
+	frameStatsReset(fs);
+	return 0;
+}
+
+void frameStatsFree(FrameStats* fs)
+{
+	if (!fs)
+		return;
+	free(fs->frames);
+	(*fs) = FRAMESTATS_CLEAR();
+}
+
+void frameStatsReset(FrameStats* fs)
+{
+	if (!fs)
+		return;
+	fs->num = 0;
+	fs->next = 0;
+}
+
+void frameStatsAdd(FrameStats* fs, const DisplayFrameStats* frame)
+{
+	if (!fs || !fs->frames || !frame)
+		return;
+	fs->frames[fs->next] = *frame;
+	fs->next = (fs->next + 1) % fs->size;
+	fs->num = MIN(fs->num + 1, fs->size);
+}
+
+
+enum { ROW_TOTAL = DISPLAY_STAGE_NUM, ROW_PIXELS, ROW_BYTES, NUM_ROWS };
+
+static const char* const rowNames[NUM_ROWS] =
+{
+	[DISPLAY_STAGE_SEEK]    = "Seek",
+	[DISPLAY_STAGE_PALETTE] = "Palette",
+	[DISPLAY_STAGE_COMBINE] = "Combine",
+	[DISPLAY_STAGE_UPLOAD]  = "Upload",
+	[DISPLAY_STAGE_PRESENT] = "Present",
+	[ROW_TOTAL]  = "Frame",
+	[ROW_PIXELS] = "Pixels",
+	[ROW_BYTES]  = "Bytes"
+};
+
+static const double percentiles[] = { 0.5, 0.9, 0.99, 1.0 };
+#define NUM_PERCENTILES SDL_arraysize(percentiles)
+
+static uint64_t rowValue(const DisplayFrameStats* frame, int row)
+{
+	if (row < DISPLAY_STAGE_NUM)
+		return frame->stageNs[row];
+	if (row == ROW_PIXELS)
+		return frame->pixels;
+	if (row == ROW_BYTES)
+		return frame->bytes;
+	uint64_t total = 0;
+	for (int i = 0; i < DISPLAY_STAGE_NUM; ++i)
+		total += frame->stageNs[i];
+	return total;
+}
+
+static int SDLCALL compareValues(const void* a, const void* b)
+{
+	const uint64_t l = *(const uint64_t*)a, r = *(const uint64_t*)b;
+	return (l > r) - (l < r);
+}
+
+// Counts fit the same columns as milliseconds by switching to K & M
+static void formatCount(char* out, size_t len, uint64_t v)
+{
+	if (v >= 10000000)
+		snprintf(out, len, "%6.1fM", (double)v / 1e6);
+	else if (v >= 100000)
+		snprintf(out, len, "%6.1fK", (double)v / 1e3);
+	else
+		snprintf(out, len, "%7" SDL_PRIu64, v);
+}
+
+int frameStatsFormat(const FrameStats* fs, char* out, size_t len)
+{
+	if (!fs || !out || !len)
+		return -1;
+	if (!fs->num)
+		return snprintf(out, len, "No frames drawn yet");
+	uint64_t* values = malloc(sizeof(uint64_t) * (size_t)fs->num);
+	if (!values)
+		return -1;
+
+	int pos = snprintf(out, len, "%-8s    p50    p90    p99    max  (ms, %d frames)", "", fs->num);
+	for (int row = 0; row < NUM_ROWS && pos >= 0 && (size_t)pos < len; ++row)
+	{
+		// Nearest rank, so every figure is a frame that actually happened
+		for (int i = 0; i < fs->num; ++i)
+			values[i] = rowValue(&fs->frames[i], row);
+		SDL_qsort(values, (size_t)fs->num, sizeof(uint64_t), compareValues);
+
+		pos += snprintf(&out[pos], len - (size_t)pos, "\n%-8s", rowNames[row]);
+		for (unsigned k = 0; k < NUM_PERCENTILES && (size_t)pos < len; ++k)
+		{
+			const int rank = MAX(1, (int)ceil(percentiles[k] * (double)fs->num));
+			const uint64_t v = values[rank - 1];
+			char col[16];
+			if (row < ROW_PIXELS)
+				snprintf(col, sizeof(col), "%7.3f", (double)v / 1e6);
+			else
+				formatCount(col, sizeof(col), v);
+			pos += snprintf(&out[pos], len - (size_t)pos, "%s", col);
+		}
+	}
+	free(values);
+	return pos;
+}
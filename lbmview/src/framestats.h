@@ -0,0 +1,27 @@
+#ifndef FRAMESTATS_H
+#define FRAMESTATS_H
+
+#include "display.h"
+#include "util.h"
+#include <stddef.h>
+
+// The last size frames' stats, older frames are overwritten as new ones arrive
+typedef struct FrameStats
+{
+	DisplayFrameStats* frames;
+	int size, num, next;
+
+} FrameStats;
+
+#define FRAMESTATS_CLEAR() CONSTASGN_CAST(FrameStats){ \
+	.frames = NULL,                                     \
+	.size = 0, .num = 0, .next = 0 }
+
+int frameStatsInit(FrameStats* fs, int size);
+void frameStatsFree(FrameStats* fs);
+void frameStatsReset(FrameStats* fs);
+void frameStatsAdd(FrameStats* fs, const DisplayFrameStats* frame);
+// Table of percentiles for each stage, the whole frame, pixels combined & bytes uploaded
+int frameStatsFormat(const FrameStats* fs, char* out, size_t len);
+
+#endif//FRAMESTATS_H
@@ -0,0 +1,545 @@
+/* gallery.c - (C) 2025 a dinosaur (zlib) */
+#include "gallery.h"
+#include "display.h"
+#include "cycle.h"
+#include "surface.h"
+#include "spancache.h"
+#include "workpool.h"
+#include "trace.h"
+#include "util.h"
+#include <SDL3/SDL.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+
+// Atlas cells start out this big & halve until every image fits in one texture
+#define GALLERY_CELL_W     320
+#define GALLERY_CELL_H     200
+#define GALLERY_MIN_CELL_W 40
+#define GALLERY_MAX_ATLAS  4096
+
+// Tiles drawn narrower than this only update a few times a second
+#define GALLERY_TINY_SIZE   64.f
+#define GALLERY_TINY_PERIOD (SDL_NS_PER_SECOND / 8)
+// Atlas pixels combined per frame, whatever's left over waits for the next
+#define GALLERY_FRAME_PIXELS (2 * 1024 * 1024)
+#define GALLERY_GAP 4.f
+
+typedef struct
+{
+	Surface surf;
+	Cycle cyc;
+	bool hasAnim;
+
+	// DPaint's thumbnail, held until the atlas size is known
+	uint8_t* tiny;
+	int tinyW, tinyH;
+
+	SDL_Rect rect;   // Where the scaled picture sits in the atlas
+	int* scaleMap;   // Source columns then rows, see surfaceCombineScaled()
+	bool full;       // Next combine must cover the whole picture, not just the spans
+	bool changed, changedFull;
+	uint64_t updated;
+} GalleryTile;
+
+struct Gallery
+{
+	SDL_Renderer* rend;
+	WorkPool* pool;
+
+	GalleryTile* tiles;
+	int numTiles;
+
+	SDL_Texture* atlas;
+	Colour* atlasPix;
+	int atlasW, atlasH;
+	int cellW, cellH, atlasCols;
+
+	// Tiles combined this frame, the next frame's picks start where this one ran out of budget
+	int* sched;
+	int numSched;
+	int cursor;
+
+	SDL_Vertex* verts;
+	int* indices;
+
+	int scrW, scrH;
+	int columns;
+	double scroll;
+	uint64_t clock;
+	int cycleMethod;
+};
+
+static const char* const galleryExts[] = { "lbm", "iff", "ilb", "ilbm", "frm", "lores", "aga" };
+
+static bool isImagePath(const char* path)
+{
+	const char* ext = SDL_strrchr(path, '.');
+	if (!ext)
+		return false;
+	for (unsigned i = 0; i < SDL_arraysize(galleryExts); ++i)
+		if (!SDL_strcasecmp(&ext[1], galleryExts[i]))
+			return true;
+	return false;
+}
+
+static int SDLCALL comparePaths(const void* a, const void* b)
+{
+	return SDL_strcasecmp(*(const char* const*)a, *(const char* const*)b);
+}
+
+static int loadTile(GalleryTile* t, const char* path, WorkPool* pool)
+{
+	FILE* file = fopen(path, "rb");
+	if (!file)
+		return -1;
+	Lbm lbm = LBM_CLEAR();
+	lbm.iocb = LBM_IO_DEFAULT(file);
+	if (lbmLoad(&lbm) || surfaceInit(&t->surf, lbm.w, lbm.h, lbm.pixels, lbm.palette))
+	{
+		lbmFree(&lbm);
+		return -1;
+	}
+	cycleInit(&t->cyc, &lbm);
+	t->hasAnim = cycleHasAnimation(&t->cyc);
+	t->tiny  = lbm.tiny;
+	t->tinyW = lbm.tinyW;
+	t->tinyH = lbm.tinyH;
+	lbm.tiny = NULL;
+	lbmFree(&lbm);
+
+	// Spans are all the scaled combines need, cached on disk same as for a single image
+	if (t->hasAnim)
+	{
+		const Cycle* c = &t->cyc;
+		const uint64_t key = spanCacheKey(&t->surf, c->rangeHigh, c->rangeLow, c->rangeRate, (int)c->numRange);
+		if (spanCacheLoad(&t->surf, key) &&
+			!surfaceComputeSpans(&t->surf, c->rangeHigh, c->rangeLow, c->rangeRate, (int)c->numRange, pool))
+			spanCacheStore(&t->surf, key);
+	}
+	return 0;
+}
+
+static void placeTileJob(void* user, int i)
+{
+	Gallery* g = user;
+	GalleryTile* t = &g->tiles[i];
+	const int w = t->surf.w, h = t->surf.h;
+
+	// Letterboxed in the middle of its cell
+	const double scale = MIN((double)g->cellW / (double)w, (double)g->cellH / (double)h);
+	const int rw = MAX(1, MIN(g->cellW, (int)round((double)w * scale)));
+	const int rh = MAX(1, MIN(g->cellH, (int)round((double)h * scale)));
+	t->rect = (SDL_Rect)
+	{
+		(i % g->atlasCols) * g->cellW + (g->cellW - rw) / 2,
+		(i / g->atlasCols) * g->cellH + (g->cellH - rh) / 2,
+		rw, rh
+	};
+
+	// Shrunk pictures are reduced once up front so cycling only ever touches the atlas-sized copy,
+	//  starting from the embedded thumbnail instead when it's at least as big
+	if (rw <= w && rh <= h && (rw < w || rh < h))
+	{
+		Surface small = SURFACE_CLEAR();
+		int res;
+		if (t->tiny && t->tinyW >= rw && t->tinyH >= rh)
+		{
+			Surface thumb = SURFACE_CLEAR();
+			const Cycle* c = &t->cyc;
+			res = surfaceInit(&thumb, t->tinyW, t->tinyH, t->tiny, t->surf.srcPal);
+			if (!res && t->hasAnim)
+				surfaceComputeSpans(&thumb, c->rangeHigh, c->rangeLow, c->rangeRate, (int)c->numRange, NULL);
+			res = res || surfaceInitScaled(&small, &thumb, rw, rh, SURFACE_SCALE_MAJORITY);
+			surfaceFree(&thumb);
+		}
+		else
+		{
+			res = surfaceInitScaled(&small, &t->surf, rw, rh, SURFACE_SCALE_MAJORITY);
+		}
+		if (!res)
+		{
+			surfaceFree(&t->surf);
+			t->surf = small;
+		}
+	}
+	free(t->tiny);
+	t->tiny = NULL;
+
+	surfaceBuildScaleMap(t->scaleMap, t->surf.w, rw);
+	surfaceBuildScaleMap(t->scaleMap + t->surf.w + 1, t->surf.h, rh);
+	t->full = true;
+}
+
+static int createAtlas(Gallery* g)
+{
+	const int maxSize = (int)MIN(GALLERY_MAX_ATLAS, SDL_GetNumberProperty(SDL_GetRendererProperties(g->rend),
+		SDL_PROP_RENDERER_MAX_TEXTURE_SIZE_NUMBER, GALLERY_MAX_ATLAS));
+	g->cellW = GALLERY_CELL_W;
+	g->cellH = GALLERY_CELL_H;
+	while (g->cellW > GALLERY_MIN_CELL_W && (maxSize / g->cellW) * (maxSize / g->cellH) < g->numTiles)
+	{
+		g->cellW /= 2;
+		g->cellH /= 2;
+	}
+	const int maxTiles = (maxSize / g->cellW) * (maxSize / g->cellH);
+	if (g->numTiles > maxTiles)
+	{
+		SDL_Log("Only showing the first %d of %d images", maxTiles, g->numTiles);
+		for (int i = maxTiles; i < g->numTiles; ++i)
+		{
+			surfaceFree(&g->tiles[i].surf);
+			free(g->tiles[i].scaleMap);
+			free(g->tiles[i].tiny);
+		}
+		g->numTiles = maxTiles;
+	}
+
+	g->atlasCols = MIN(g->numTiles, maxSize / g->cellW);
+	g->atlasW = g->atlasCols * g->cellW;
+	g->atlasH = (g->numTiles + g->atlasCols - 1) / g->atlasCols * g->cellH;
+	g->atlasPix = calloc((size_t)g->atlasW * (size_t)g->atlasH, sizeof(Colour));
+	g->atlas = SDL_CreateTexture(g->rend, SDL_PIXELFORMAT_BGRA32, SDL_TEXTUREACCESS_STREAMING, g->atlasW, g->atlasH);
+	if (!g->atlasPix || !g->atlas)
+		return -1;
+	SDL_SetTextureBlendMode(g->atlas, SDL_BLENDMODE_NONE);
+	SDL_SetTextureScaleMode(g->atlas, SDL_SCALEMODE_NEAREST);
+	SDL_UpdateTexture(g->atlas, NULL, g->atlasPix, g->atlasW * (int)sizeof(Colour));
+
+	// Reducing every picture is a full pass over each, so they're spread over the pool,
+	//  with the shared setup done here first rather than by whichever worker gets there
+	surfaceSetup();
+	workPoolRun(g->pool, placeTileJob, g, g->numTiles);
+	return 0;
+}
+
+Gallery* galleryInit(SDL_Renderer* renderer, const char* dirPath)
+{
+	if (!renderer || !dirPath)
+		return NULL;
+
+	Gallery* g = SDL_malloc(sizeof(Gallery));
+	if (!g)
+		return NULL;
+	(*g) = (Gallery)
+	{
+		.rend  = renderer,
+		.pool  = NULL,
+		.tiles = NULL,
+		.numTiles = 0,
+		.atlas    = NULL,
+		.atlasPix = NULL,
+		.sched    = NULL,
+		.numSched = 0,
+		.cursor   = 0,
+		.verts    = NULL,
+		.indices  = NULL,
+		.scrW = 0, .scrH = 0,
+		.columns = 0,  // Picked by galleryResize()
+		.scroll  = 0.0,
+		.clock   = 0,
+		.cycleMethod = DISPLAY_CYCLEMETHOD_SRGB
+	};
+	g->pool = workPoolCreate(SDL_GetNumLogicalCPUCores() - 1);
+
+	int numPaths = 0;
+	char** paths = SDL_GlobDirectory(dirPath, NULL, 0, &numPaths);
+	if (!paths)
+	{
+		galleryFree(g);
+		return NULL;
+	}
+	SDL_qsort(paths, (size_t)numPaths, sizeof(char*), comparePaths);
+	g->tiles = calloc((size_t)MAX(1, numPaths), sizeof(GalleryTile));
+	for (int i = 0; g->tiles && i < numPaths; ++i)
+	{
+		if (!isImagePath(paths[i]))
+			continue;
+		char* path = NULL;
+		if (SDL_asprintf(&path, "%s/%s", dirPath, paths[i]) < 0)
+			continue;
+		GalleryTile* t = &g->tiles[g->numTiles];
+		(*t) = (GalleryTile){ .surf = SURFACE_CLEAR(), .tiny = NULL, .scaleMap = NULL };
+		if (loadTile(t, path, g->pool)
+			|| !(t->scaleMap = malloc(sizeof(int) * (size_t)(t->surf.w + t->surf.h + 2))))
+		{
+			SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Skipping \"%s\"", path);
+			surfaceFree(&t->surf);
+			free(t->tiny);
+		}
+		else
+		{
+			++g->numTiles;
+		}
+		SDL_free(path);
+	}
+	SDL_free(paths);
+	if (!g->numTiles || createAtlas(g))
+	{
+		galleryFree(g);
+		return NULL;
+	}
+
+	// Index pattern never changes, only how many quads are drawn
+	g->sched = malloc(sizeof(int) * (size_t)g->numTiles);
+	g->verts = malloc(sizeof(SDL_Vertex) * 4 * (size_t)g->numTiles);
+	g->indices = malloc(sizeof(int) * 6 * (size_t)g->numTiles);
+	if (!g->sched || !g->verts || !g->indices)
+	{
+		galleryFree(g);
+		return NULL;
+	}
+	for (int i = 0; i < g->numTiles; ++i)
+	{
+		int* idx = &g->indices[i * 6];
+		const int base = i * 4;
+		idx[0] = base;
+		idx[1] = base + 1;
+		idx[2] = base + 2;
+		idx[3] = base;
+		idx[4] = base + 2;
+		idx[5] = base + 3;
+	}
+
+	int w = 0, h = 0;
+	SDL_GetCurrentRenderOutputSize(renderer, &w, &h);
+	galleryResize(g, w, h);
+	return g;
+}
+
+void galleryFree(Gallery* g)
+{
+	if (!g)
+		return;
+	for (int i = 0; i < g->numTiles; ++i)
+	{
+		surfaceFree(&g->tiles[i].surf);
+		free(g->tiles[i].scaleMap);
+		free(g->tiles[i].tiny);
+	}
+	free(g->tiles);
+	free(g->sched);
+	free(g->verts);
+	free(g->indices);
+	free(g->atlasPix);
+	SDL_DestroyTexture(g->atlas);
+	workPoolFree(g->pool);
+	SDL_free(g);
+}
+
+int galleryNumTiles(const Gallery* g)
+{
+	return g ? g->numTiles : 0;
+}
+
+
+static float rowHeight(const Gallery* g)
+{
+	const float scale = ((float)g->scrW / (float)g->columns - GALLERY_GAP) / (float)g->cellW;
+	return (float)g->cellH * scale + GALLERY_GAP;
+}
+
+// Where a tile's picture lands on screen
+static SDL_FRect tileScreenRect(const Gallery* g, int i)
+{
+	const GalleryTile* t = &g->tiles[i];
+	const float cellW = (float)g->scrW / (float)g->columns, cellH = rowHeight(g);
+	const float scale = (cellW - GALLERY_GAP) / (float)g->cellW;
+	const float ox = (float)(t->rect.x - (i % g->atlasCols) * g->cellW);
+	const float oy = (float)(t->rect.y - (i / g->atlasCols) * g->cellH);
+	return (SDL_FRect)
+	{
+		(float)(i % g->columns) * cellW + GALLERY_GAP * 0.5f + ox * scale,
+		((float)(i / g->columns) - (float)g->scroll) * cellH + GALLERY_GAP * 0.5f + oy * scale,
+		(float)t->rect.w * scale,
+		(float)t->rect.h * scale
+	};
+}
+
+static bool isOnScreen(const Gallery* g, const SDL_FRect* r)
+{
+	return r->y + r->h > 0.f && r->y < (float)g->scrH && r->w > 0.f;
+}
+
+static void schedule(Gallery* g)
+{
+	g->numSched = 0;
+	int64_t budget = GALLERY_FRAME_PIXELS;
+	for (int n = 0; n < g->numTiles; ++n)
+	{
+		const int i = (g->cursor + n) % g->numTiles;
+		GalleryTile* t = &g->tiles[i];
+
+		// Offscreen tiles stop entirely, seeking catches them straight up once they're back
+		const SDL_FRect r = tileScreenRect(g, i);
+		if (!isOnScreen(g, &r))
+			continue;
+		if (!t->full)
+		{
+			if (!t->hasAnim || t->updated == g->clock)
+				continue;
+			const uint64_t age = g->clock > t->updated ? g->clock - t->updated : t->updated - g->clock;
+			if (r.w < GALLERY_TINY_SIZE && age < GALLERY_TINY_PERIOD)
+				continue;
+		}
+
+		// Span combines only touch the cycling pixels, scaled down with the rest of the picture
+		int64_t cost = (int64_t)t->rect.w * t->rect.h;
+		if (!t->full && t->surf.spans && t->surf.spanBeg >= 0)
+			cost = MAX(1, (int64_t)((double)cost * (double)t->surf.spanPixels / ((double)t->surf.w * t->surf.h)));
+		if (g->numSched && cost > budget)
+		{
+			g->cursor = i;
+			return;
+		}
+		budget -= cost;
+		g->sched[g->numSched++] = i;
+	}
+}
+
+static void updateTileJob(void* user, int index)
+{
+	Gallery* g = user;
+	GalleryTile* t = &g->tiles[g->sched[index]];
+	Surface* surf = &t->surf;
+
+	uint16_t dirtyRanges = 0;
+	bool changed = false;
+	if (t->hasAnim)
+	{
+		cycleSeek(&t->cyc, g->clock);
+		changed = cycleUpdatePalette(&t->cyc, surf, g->cycleMethod, &dirtyRanges);
+	}
+	t->updated = g->clock;
+	t->changed = changed || t->full;
+	if (!t->changed)
+		return;
+
+	// Tiles are small, so each is combined whole on one thread & the pool runs many at once
+	t->changedFull = t->full || !surf->spans || surf->spanBeg < 0;
+	surf->dst = &g->atlasPix[(size_t)t->rect.y * (size_t)g->atlasW + (size_t)t->rect.x];
+	surf->dstStride = (size_t)g->atlasW;
+	surf->dstX = surf->dstY = 0;
+	surfaceCombineScaled(surf, t->scaleMap, t->scaleMap + surf->w + 1, t->changedFull, NULL);
+	surf->dst = NULL;
+	t->full = false;
+}
+
+static void uploadTile(Gallery* g, const GalleryTile* t)
+{
+	SDL_Rect rect = t->rect;
+	if (!t->changedFull)
+	{
+		const int* cols = t->scaleMap, * rows = t->scaleMap + t->surf.w + 1;
+		const SurfRect b = t->surf.dirtyBounds;
+		rect = (SDL_Rect){ t->rect.x + cols[b.x], t->rect.y + rows[b.y],
+			cols[b.x + b.w] - cols[b.x], rows[b.y + b.h] - rows[b.y] };
+	}
+	if (rect.w > 0 && rect.h > 0)
+		SDL_UpdateTexture(g->atlas, &rect, &g->atlasPix[(size_t)rect.y * (size_t)g->atlasW + (size_t)rect.x],
+			g->atlasW * (int)sizeof(Colour));
+}
+
+void galleryRepaint(Gallery* g)
+{
+	if (!g || g->scrW <= 0 || g->scrH <= 0)
+		return;
+
+	schedule(g);
+	workPoolRun(g->pool, updateTileJob, g, g->numSched);
+	for (int i = 0; i < g->numSched; ++i)
+		if (g->tiles[g->sched[i]].changed)
+			uploadTile(g, &g->tiles[g->sched[i]]);
+
+	// Every visible tile in one batch out of the atlas
+	const SDL_FColor white = { 1.f, 1.f, 1.f, 1.f };
+	const float sw = 1.f / (float)g->atlasW, sh = 1.f / (float)g->atlasH;
+	int numQuads = 0;
+	for (int i = 0; i < g->numTiles; ++i)
+	{
+		const SDL_FRect r = tileScreenRect(g, i);
+		if (!isOnScreen(g, &r))
+			continue;
+		const SDL_Rect* src = &g->tiles[i].rect;
+		const float u0 = (float)src->x * sw, u1 = (float)(src->x + src->w) * sw;
+		const float v0 = (float)src->y * sh, v1 = (float)(src->y + src->h) * sh;
+		SDL_Vertex* v = &g->verts[numQuads++ * 4];
+		v[0] = (SDL_Vertex){ { r.x, r.y }, white, { u0, v0 } };
+		v[1] = (SDL_Vertex){ { r.x + r.w, r.y }, white, { u1, v0 } };
+		v[2] = (SDL_Vertex){ { r.x + r.w, r.y + r.h }, white, { u1, v1 } };
+		v[3] = (SDL_Vertex){ { r.x, r.y + r.h }, white, { u0, v1 } };
+	}
+
+	SDL_SetRenderDrawColor(g->rend, 0x00, 0x00, 0x00, 0xFF);
+	SDL_RenderClear(g->rend);
+	if (numQuads)
+		SDL_RenderGeometry(g->rend, g->atlas, g->verts, numQuads * 4, g->indices, numQuads * 6);
+	TRACE_BEGIN(zone);
+	SDL_RenderPresent(g->rend);
+	TRACE_END(zone, "SDL_RenderPresent");
+}
+
+void gallerySeek(Gallery* g, uint64_t t)
+{
+	if (g)
+		g->clock = t;
+}
+
+
+void gallerySetCycleMethod(Gallery* g, int method)
+{
+	if (!g || method < 0 || method >= DISPLAY_CYCLEMETHOD_NUM)
+		return;
+	g->cycleMethod = method;
+	for (int i = 0; i < g->numTiles; ++i)
+	{
+		GalleryTile* t = &g->tiles[i];
+		if (!t->hasAnim)
+			continue;
+		if (method == DISPLAY_CYCLEMETHOD_STEP)
+			cycleResetPalette(&t->cyc, &t->surf);
+		t->full = true;
+	}
+}
+
+int galleryGetCycleMethod(const Gallery* g)
+{
+	return g ? g->cycleMethod : -1;
+}
+
+static void clampScroll(Gallery* g)
+{
+	const int rows = (g->numTiles + g->columns - 1) / g->columns;
+	const double maxScroll = MAX(0.0, (double)rows - (double)g->scrH / (double)rowHeight(g));
+	g->scroll = MAX(0.0, MIN(g->scroll, maxScroll));
+}
+
+void galleryResize(Gallery* g, int w, int h)
+{
+	if (!g)
+		return;
+	g->scrW = w;
+	g->scrH = h;
+	if (!g->columns)
+		g->columns = MAX(1, MIN(g->numTiles, w / g->cellW));
+	clampScroll(g);
+}
+
+void galleryScroll(Gallery* g, double rows)
+{
+	if (!g)
+		return;
+	g->scroll += rows;
+	clampScroll(g);
+}
+
+void galleryZoom(Gallery* g, int delta)
+{
+	if (!g)
+		return;
+	// Keep the top row's first tile in view as the grid reflows
+	const int top = (int)g->scroll * g->columns;
+	g->columns = MAX(1, MIN(g->numTiles, g->columns + delta));
+	g->scroll = (double)(top / g->columns);
+	clampScroll(g);
+}
@@ -0,0 +1,30 @@
+#ifndef GALLERY_H
+#define GALLERY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct Gallery Gallery;
+
+typedef struct SDL_Renderer SDL_Renderer;
+
+// Every image in a directory as animated tiles, sharing one atlas texture & one worker pool
+Gallery* galleryInit(SDL_Renderer* renderer, const char* dirPath);
+void galleryFree(Gallery* g);
+
+int galleryNumTiles(const Gallery* g);
+
+void galleryRepaint(Gallery* g);
+// Same clock as displaySeek(), in nanoseconds at normal speed
+void gallerySeek(Gallery* g, uint64_t t);
+
+void gallerySetCycleMethod(Gallery* g, int method);
+int galleryGetCycleMethod(const Gallery* g);
+
+void galleryResize(Gallery* g, int w, int h);
+// Moves the view by rows of tiles, positive is down
+void galleryScroll(Gallery* g, double rows);
+// Fits more (positive) or fewer (negative) tiles across the window
+void galleryZoom(Gallery* g, int delta);
+
+#endif//GALLERY_H
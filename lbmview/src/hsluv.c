@@ -30,6 +30,7 @@
 
 #include <float.h>
 #include <math.h>
+#include <string.h>
 
 
 #define CLAMP(val, min_val, max_val)        \
@@ -459,3 +460,270 @@ rgb2hpluv(double r, double g, double b, double* ph, double* ps, double* pl)
 
     return (0.0 <= tmp.b  &&  tmp.b <= 100.0) ? 0 : -1;
 }
+
+
+
+/* Batch conversions
+ *
+ * Single precision and branch-free so that the loops below can be
+ * vectorised: the transcendental functions are replaced by polynomial
+ * approximations and conditionals by selects. Their error is well under
+ * what 8-bit color can show.
+ */
+
+static inline float
+bits2float(unsigned int i)
+{
+    float f;
+    memcpy(&f, &i, sizeof(f));
+    return f;
+}
+
+static inline unsigned int
+float2bits(float f)
+{
+    unsigned int i;
+    memcpy(&i, &f, sizeof(i));
+    return i;
+}
+
+/* For x > 0, splits off the exponent so the series runs on [sqrt(1/2), sqrt(2)) */
+static inline float
+fast_log2f(float x)
+{
+    unsigned int bits = float2bits(x) - 0x3F3504F3u;   /* sqrt(1/2) */
+    float e = (float)((int)bits >> 23);
+    float m = bits2float((bits & 0x007FFFFFu) + 0x3F3504F3u);
+    float z = (m - 1.0f) / (m + 1.0f);
+    float z2 = z * z;
+    float p = 2.0f + z2 * (0.66666667f + z2 * (0.4f + z2 * (0.28571429f + z2 * 0.22222222f)));
+    return e + z * p * 1.44269504f;   /* (1 / ln 2) */
+}
+
+static inline float
+fast_exp2f(float x)
+{
+    x = CLAMP(x, -126.0f, 126.0f);
+    int i = (int)x;
+    i -= (x < (float)i);
+    float f = (x - (float)i) * 0.69314718f;   /* (ln 2) */
+    float p = 1.0f + f * (1.0f + f * (0.5f + f * (0.16666667f + f * (0.04166667f
+        + f * (0.00833333f + f * (0.00138889f + f * 0.00019841f))))));
+    return p * bits2float((unsigned int)(i + 127) << 23);
+}
+
+static inline float
+fast_powf(float x, float y)
+{
+    return fast_exp2f(fast_log2f(x > FLT_MIN ? x : FLT_MIN) * y);
+}
+
+/* Sine & cosine of x in [-pi, pi], folded into [-pi/2, pi/2] */
+static inline void
+fast_sincosf(float x, float* ps, float* pc)
+{
+    float ax = fabsf(x);
+    float fold = 3.14159265f - ax;
+    int flip = ax > 1.57079633f;
+    float r = flip ? fold : ax;
+    float r2 = r * r;
+    float s = r * (1.0f + r2 * (-0.16666667f + r2 * (0.00833333f + r2 * (-0.00019841f + r2 * 0.0000027557f))));
+    float c = 1.0f + r2 * (-0.5f + r2 * (0.04166667f + r2 * (-0.00138889f + r2 * (0.0000248016f - r2 * 0.000000275573f))));
+    *ps = copysignf(s, x);
+    *pc = flip ? -c : c;
+}
+
+static inline float
+fast_atan2f(float y, float x)
+{
+    float ax = fabsf(x);
+    float ay = fabsf(y);
+    float mx = ax > ay ? ax : ay;
+    float mn = ax > ay ? ay : ax;
+    float a = mn / (mx > FLT_MIN ? mx : FLT_MIN);
+    float s = a * a;
+    float r = a * (0.99997726f + s * (-0.33262347f + s * (0.19354346f + s * (-0.11643287f
+        + s * (0.05265332f + s * -0.01172120f)))));
+    float rc = 1.57079633f - r;
+    r = ay > ax ? rc : r;
+    float rs = 3.14159265f - r;
+    r = x < 0.0f ? rs : r;
+    return copysignf(r, y);
+}
+
+/* Both sides of each select are evaluated up front, which lets compilers
+ * if-convert them without worrying about floating point traps */
+static inline float
+from_linear_f(float c)
+{
+    float lin = 12.92f * c;
+    float curve = 1.055f * fast_powf(c, 1.0f / 2.4f) - 0.055f;
+    return c <= 0.0031308f ? lin : curve;
+}
+
+static inline float
+to_linear_f(float c)
+{
+    float lin = c * (1.0f / 12.92f);
+    float curve = fast_powf((c + 0.055f) * (1.0f / 1.055f), 2.4f);
+    return c > 0.04045f ? curve : lin;
+}
+
+/* The chroma bounds from get_bounds() are, for each of the six lines,
+ *   a = k1 * sub2 / bottom,  b = (k2 * sub2 - 769860 * t) * l / bottom,
+ *   bottom = k3 * sub2 + 126452 * t,
+ * so only the per-channel constants need to be worked out up front. The
+ * divisions by bottom cancel out of the ray intersections used below. */
+typedef struct BoundCoefs_tag BoundCoefs;
+struct BoundCoefs_tag {
+    float k1[3];
+    float k2[3];
+    float k3[3];
+};
+
+static void
+get_bound_coefs(BoundCoefs* coefs)
+{
+    int channel;
+
+    for(channel = 0; channel < 3; channel++) {
+        double m1 = m[channel].a;
+        double m2 = m[channel].b;
+        double m3 = m[channel].c;
+
+        coefs->k1[channel] = (float)(284517.0 * m1 - 94839.0 * m3);
+        coefs->k2[channel] = (float)(838422.0 * m3 + 769860.0 * m2 + 731718.0 * m1);
+        coefs->k3[channel] = (float)(632260.0 * m3 - 126452.0 * m2);
+    }
+}
+
+static inline float
+sub2_for_l(float l)
+{
+    float tl = l + 16.0f;
+    float sub1 = (tl * tl * tl) * (1.0f / 1560896.0f);
+    float lin = l * (float)(1.0 / kappa);
+    return sub1 > (float)epsilon ? sub1 : lin;
+}
+
+void
+hsluv2rgb_batch(const float* restrict h, const float* restrict s, const float* restrict l,
+                float* restrict r, float* restrict g, float* restrict b, size_t n)
+{
+    BoundCoefs coefs;
+    size_t i;
+    int channel;
+
+    get_bound_coefs(&coefs);
+    for(i = 0; i < n; i++) {
+        float hi = h[i];
+        float si = s[i];
+        float li = l[i];
+        float sin_h, cos_h;
+        float sub2 = sub2_for_l(li);
+        float min_len = FLT_MAX;
+
+        float hi_wrap = hi - 360.0f;
+        fast_sincosf((hi > 180.0f ? hi_wrap : hi) * 0.01745329f, &sin_h, &cos_h);
+
+        /* max_chroma_for_lh(): with a & b as above, the ray length
+         * b / (sin - a * cos) becomes top2 / (bottom * sin - top1 * cos) */
+        for(channel = 0; channel < 3; channel++) {
+            float top1 = coefs.k1[channel] * sub2;
+            float top2_0 = coefs.k2[channel] * sub2 * li;
+            float bottom_0 = coefs.k3[channel] * sub2;
+            float len0 = top2_0 / (bottom_0 * sin_h - top1 * cos_h);
+            float len1 = (top2_0 - 769860.0f * li) / ((bottom_0 + 126452.0f) * sin_h - top1 * cos_h);
+
+            min_len = (len0 >= 0.0f) & (len0 < min_len) ? len0 : min_len;
+            min_len = (len1 >= 0.0f) & (len1 < min_len) ? len1 : min_len;
+        }
+
+        /* hsluv2lch(), lch2luv() */
+        float chroma = min_len * 0.01f * si;
+        float c = (li > 99.9999f) | (li < 0.00001f) ? 0.0f : chroma;
+        float u = cos_h * c;
+        float v = sin_h * c;
+
+        /* luv2xyz(), with black clamped away rather than branched around */
+        float l13 = 13.0f * (li > 0.00001f ? li : 0.00001f);
+        float var_u = u / l13 + (float)ref_u;
+        float var_v = v / l13 + (float)ref_v;
+        float xl = (li + 16.0f) / 116.0f;
+        float y_lin = li * (float)(1.0 / kappa);
+        float y_cube = xl * xl * xl;
+        float y = li <= 8.0f ? y_lin : y_cube;
+        float x = (9.0f * y * var_u) / (4.0f * var_v);
+        float z = (9.0f * y - (15.0f * var_v * y) - (var_v * x)) / (3.0f * var_v);
+
+        /* xyz2rgb() */
+        float rl = (float)m[0].a * x + (float)m[0].b * y + (float)m[0].c * z;
+        float gl = (float)m[1].a * x + (float)m[1].b * y + (float)m[1].c * z;
+        float bl = (float)m[2].a * x + (float)m[2].b * y + (float)m[2].c * z;
+        r[i] = CLAMP(from_linear_f(rl), 0.0f, 1.0f);
+        g[i] = CLAMP(from_linear_f(gl), 0.0f, 1.0f);
+        b[i] = CLAMP(from_linear_f(bl), 0.0f, 1.0f);
+    }
+}
+
+void
+rgb2hsluv_batch(const float* restrict r, const float* restrict g, const float* restrict b,
+                float* restrict h, float* restrict s, float* restrict l, size_t n)
+{
+    BoundCoefs coefs;
+    size_t i;
+    int channel;
+
+    get_bound_coefs(&coefs);
+    for(i = 0; i < n; i++) {
+        /* rgb2xyz() */
+        float rl = to_linear_f(r[i]);
+        float gl = to_linear_f(g[i]);
+        float bl = to_linear_f(b[i]);
+        float x = (float)m_inv[0].a * rl + (float)m_inv[0].b * gl + (float)m_inv[0].c * bl;
+        float y = (float)m_inv[1].a * rl + (float)m_inv[1].b * gl + (float)m_inv[1].c * bl;
+        float z = (float)m_inv[2].a * rl + (float)m_inv[2].b * gl + (float)m_inv[2].c * bl;
+
+        /* xyz2luv() */
+        float denom = x + (15.0f * y) + (3.0f * z);
+        denom = denom > FLT_MIN ? denom : FLT_MIN;
+        float l_lin = y * (float)kappa;
+        float l_cbrt = 116.0f * fast_powf(y, 1.0f / 3.0f) - 16.0f;
+        float li = y <= (float)epsilon ? l_lin : l_cbrt;
+        float u_raw = 13.0f * li * ((4.0f * x) / denom - (float)ref_u);
+        float v_raw = 13.0f * li * ((9.0f * y) / denom - (float)ref_v);
+        float u = li < 0.00001f ? 0.0f : u_raw;
+        float v = li < 0.00001f ? 0.0f : v_raw;
+
+        /* luv2lch(), only the hue is needed as chroma cancels out below.
+         * Grays pick up more rounding noise in single precision, but real
+         * chroma is never this low for 8-bit colors. */
+        float c2 = u * u + v * v;
+        float hi = fast_atan2f(v, u) * 57.29577951f;
+        float hi_wrap = hi + 360.0f;
+        hi = hi < 0.0f ? hi_wrap : hi;
+        hi = c2 < 0.0001f ? 0.0f : hi;
+
+        /* lch2hsluv(): the hue's sine & cosine are v / c & u / c, so
+         * c / ray length is (bottom * v - top1 * u) / top2 for each line,
+         * and the saturation is the largest non-negative of them */
+        float sub2 = sub2_for_l(li);
+        float max_ratio = 0.0f;
+        for(channel = 0; channel < 3; channel++) {
+            float top1 = coefs.k1[channel] * sub2;
+            float top2_0 = coefs.k2[channel] * sub2 * li;
+            float bottom_0 = coefs.k3[channel] * sub2;
+            float ratio0 = (bottom_0 * v - top1 * u) / top2_0;
+            float ratio1 = ((bottom_0 + 126452.0f) * v - top1 * u) / (top2_0 - 769860.0f * li);
+
+            max_ratio = ratio0 > max_ratio ? ratio0 : max_ratio;
+            max_ratio = ratio1 > max_ratio ? ratio1 : max_ratio;
+        }
+        float sat = max_ratio * 100.0f;
+        float si = (li > 99.9999f) | (li < 0.00001f) ? 0.0f : sat;
+
+        h[i] = CLAMP(hi, 0.0f, 360.0f);
+        s[i] = CLAMP(si, 0.0f, 100.0f);
+        l[i] = CLAMP(li, 0.0f, 100.0f);
+    }
+}
@@ -29,6 +29,8 @@
 #ifndef HSLUV_H
 #define HSLUV_H
 
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -105,6 +107,38 @@ void hpluv2rgb(double h, double s, double l, double* pr, double* pg, double* pb)
  */
 int rgb2hpluv(double r, double g, double b, double* ph, double* ps, double* pl);
 
+/**
+ * Convert arrays of HSLuv colors to RGB, in single precision.
+ *
+ * The arrays are in structure-of-arrays layout, and must not overlap.
+ * Results are within 1/255 of hsluv2rgb().
+ *
+ * @param h Hues. Between 0.0 and 360.0.
+ * @param s Saturations. Between 0.0 and 100.0.
+ * @param l Lightnesses. Between 0.0 and 100.0.
+ * @param[out] r Red components. Between 0.0 and 1.0.
+ * @param[out] g Green components. Between 0.0 and 1.0.
+ * @param[out] b Blue components. Between 0.0 and 1.0.
+ * @param n Number of colors.
+ */
+void hsluv2rgb_batch(const float* h, const float* s, const float* l, float* r, float* g, float* b, size_t n);
+
+/**
+ * Convert arrays of RGB colors to HSLuv, in single precision.
+ *
+ * The arrays are in structure-of-arrays layout, and must not overlap.
+ * Results are within 1/255 of rgb2hsluv().
+ *
+ * @param r Red components. Between 0.0 and 1.0.
+ * @param g Green components. Between 0.0 and 1.0.
+ * @param b Blue components. Between 0.0 and 1.0.
+ * @param[out] h Hues. Between 0.0 and 360.0.
+ * @param[out] s Saturations. Between 0.0 and 100.0.
+ * @param[out] l Lightnesses. Between 0.0 and 100.0.
+ * @param n Number of colors.
+ */
+void rgb2hsluv_batch(const float* r, const float* g, const float* b, float* h, float* s, float* l, size_t n);
+
 
 #ifdef __cplusplus
 }
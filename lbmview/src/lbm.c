@@ -1,12 +1,13 @@
 /* lbm.c - (C) 2023, 2024 a dinosaur (zlib) */
 #include "lbm.h"
 #include "lbmdef.h"
+#include "trace.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
 
 
-typedef enum { CHUNK_BMHD = 1, CHUNK_CMAP = 1 << 1, CHUNK_CAMG = 1 << 2, CHUNK_BODY = 1 << 3 } LbmChunkMask;
+typedef enum { CHUNK_BMHD = 1, CHUNK_CMAP = 1 << 1, CHUNK_CAMG = 1 << 2, CHUNK_BODY = 1 << 3, CHUNK_TINY = 1 << 4 } LbmChunkMask;
 
 typedef struct
 {
@@ -36,6 +37,9 @@ typedef struct
 	uint8_t* body;
 	unsigned bodyLen;
 
+	uint16_t tinyW, tinyH;
+	uint8_t* tiny;
+
 } LbmReaderState;
 
 
@@ -272,25 +276,26 @@ static size_t lbmReadRleRow(LbmReaderState* s, uint8_t* dst, size_t rowLen, size
 	return dstRead;
 }
 
-static size_t lbmReadPbm(LbmReaderState* s, uint8_t* pix, size_t pixLen, size_t chunkLen)
+static size_t lbmReadPbm(LbmReaderState* s, uint8_t* pix, unsigned w, unsigned h, size_t chunkLen)
 {
+	const size_t pixLen = w * (size_t)h;
 	if (s->bmhd.compression == CMP_NONE)
 	{
 		size_t len = MIN(pixLen, chunkLen);
 		IO_READ(pix, 1, len);
 		if (len < pixLen)
-			memset(&pix[len], 0, len - pixLen);
+			memset(&pix[len], 0, pixLen - len);
 		return len;
 	}
 	else if (s->bmhd.compression == CMP_BYTE_RUN1)
 	{
 		size_t read = 0;
-		const size_t stride = s->bmhd.w;
-		for (unsigned j = 0; j < s->bmhd.h; ++j)
+		const size_t stride = w;
+		for (unsigned j = 0; j < h; ++j)
 		{
 			size_t rowRead = lbmReadRleRow(s, pix, stride, chunkLen, &read);
 			if (rowRead < stride)
-				memset(&pix[rowRead], 0, rowRead - stride);
+				memset(&pix[rowRead], 0, stride - rowRead);
 			pix += stride;
 		}
 		return read;
@@ -298,9 +303,9 @@ static size_t lbmReadPbm(LbmReaderState* s, uint8_t* pix, size_t pixLen, size_t
 	return SIZE_MAX;
 }
 
-static size_t lbmReadIlbm(LbmReaderState* s, uint8_t* pix, size_t pixLen, size_t chunkLen)
+static size_t lbmReadIlbm(LbmReaderState* s, uint8_t* pix, unsigned w, unsigned h, size_t chunkLen)
 {
-	const unsigned pixStride = s->bmhd.w;
+	const unsigned pixStride = w;
 	const unsigned numPlanes = s->bmhd.numPlanes;
 	const unsigned planeStride = ((((pixStride * numPlanes + 7) / 8) + numPlanes - 1) / numPlanes); // Word align or?
 
@@ -311,7 +316,7 @@ static size_t lbmReadIlbm(LbmReaderState* s, uint8_t* pix, size_t pixLen, size_t
 
 	size_t read = 0;
 	uint8_t* pixRow = pix;
-	for (unsigned j = 0; j < s->bmhd.h; ++j)
+	for (unsigned j = 0; j < h; ++j)
 	{
 		// Read planar data into temporary buffer
 		size_t irowRead, prowRead;
@@ -385,9 +390,9 @@ static int lbmReadBody(LbmReaderState* s, const IffChunkHeader* chunk)
 
 	size_t len = chunk->chunkLen;
 	if (FOURCC_CMP(s->formatId, IFF_PBM))
-		len = lbmReadPbm(s, s->body, pixLen, len);
+		len = lbmReadPbm(s, s->body, s->bmhd.w, s->bmhd.h, len);
 	else if (FOURCC_CMP(s->formatId, IFF_ILBM))
-		len = lbmReadIlbm(s, s->body, pixLen, len);
+		len = lbmReadIlbm(s, s->body, s->bmhd.w, s->bmhd.h, len);
 	if (len == SIZE_MAX)
 		return -1;
 
@@ -397,6 +402,44 @@ static int lbmReadBody(LbmReaderState* s, const IffChunkHeader* chunk)
 	return 0;
 }
 
+static int lbmReadThumbnail(LbmReaderState* s, const IffChunkHeader* chunk)
+{
+	// Needs the header's planes & compression, a misplaced, repeated, or truncated
+	//  thumbnail is skipped like an unknown chunk since the picture itself is still fine
+	if (s->chunkMask & CHUNK_TINY || !(s->chunkMask & CHUNK_BMHD) || chunk->chunkLen < TINY_HEAD_SIZE)
+	{
+		IO_SEEK(chunk->realLen, LBMIO_SEEK_CUR);
+		return 0;
+	}
+
+	IO_READ_UWORD(s->tinyW);
+	IO_READ_UWORD(s->tinyH);
+
+	// A thumbnail bigger than the picture is no use, skip it rather than reject the file
+	if (!s->tinyW || !s->tinyH || s->tinyW > s->bmhd.w || s->tinyH > s->bmhd.h)
+	{
+		IO_CHUNK_SKIP(TINY_HEAD_SIZE);
+		return 0;
+	}
+
+	s->tiny = malloc(s->tinyW * (size_t)s->tinyH);
+	if (!s->tiny)
+		return -1;
+
+	size_t len = chunk->chunkLen - TINY_HEAD_SIZE;
+	if (FOURCC_CMP(s->formatId, IFF_PBM))
+		len = lbmReadPbm(s, s->tiny, s->tinyW, s->tinyH, len);
+	else if (FOURCC_CMP(s->formatId, IFF_ILBM))
+		len = lbmReadIlbm(s, s->tiny, s->tinyW, s->tinyH, len);
+	if (len == SIZE_MAX)
+		return -1;
+
+	s->chunkMask |= CHUNK_TINY;
+
+	IO_CHUNK_SKIP(TINY_HEAD_SIZE + len);
+	return 0;
+}
+
 static int lbmReadCustom(LbmReaderState* s, const IffChunkHeader* chunk)
 {
 	if (chunk->chunkLen > s->customLen)
@@ -437,13 +480,26 @@ static int lbmReadSections(LbmReaderState* s)
 		else if (FOURCC_CMP(IFF_CRNG, chunk.chunkId)) res = lbmReadColourRange(s, &chunk);
 		else if (FOURCC_CMP(IFF_DRNG, chunk.chunkId)) res = lbmReadExtendedRange(s, &chunk);
 		else if (FOURCC_CMP(IFF_CCRT, chunk.chunkId)) res = lbmReadGraphicraftRange(s, &chunk);
-		else if (FOURCC_CMP(IFF_BODY, chunk.chunkId)) res = lbmReadBody(s, &chunk);
+		else if (FOURCC_CMP(IFF_BODY, chunk.chunkId))
+		{
+			TRACE_BEGIN(zone);
+			res = lbmReadBody(s, &chunk);
+			TRACE_END(zone, "lbmReadBody");
+		}
+		else if (FOURCC_CMP(IFF_TINY, chunk.chunkId))
+		{
+			TRACE_BEGIN(zone);
+			res = lbmReadThumbnail(s, &chunk);
+			TRACE_END(zone, "lbmReadThumbnail");
+		}
 		else
 		{
 			if (s->customSub && s->customHndl && s->customSub(chunk.chunkId))
 			{
+				TRACE_BEGIN(zone);
 				if (lbmReadCustom(s, &chunk))
 					res = -1;
+				TRACE_END(zone, "lbmReadCustom");
 			}
 			else { IO_SEEK(chunk.realLen, LBMIO_SEEK_CUR); }
 		}
@@ -482,9 +538,11 @@ int lbmLoad(Lbm* out)
 		.numDrng = 0,
 		.numCcrt = 0,
 		.numCmap = 0,
-		.camgViewMode = 0
+		.camgViewMode = 0,
+		.tiny = NULL
 	};
 	int res = -1;
+	TRACE_BEGIN(zone);
 
 	// Read chunks
 	s.form = iffReadChunk(&s);
@@ -503,6 +561,13 @@ int lbmLoad(Lbm* out)
 	out->w = s.bmhd.w;
 	out->h = s.bmhd.h;
 	out->pixels = s.body;
+	if (s.chunkMask & CHUNK_TINY)
+	{
+		out->tinyW = s.tinyW;
+		out->tinyH = s.tinyH;
+		out->tiny  = s.tiny;
+		s.tiny = NULL;
+	}
 
 	// Copy palette
 	if (s.numCmap > 0)
@@ -557,8 +622,11 @@ int lbmLoad(Lbm* out)
 cleanup:
 	if (s.custom)
 		free(s.custom);
+	if (s.tiny)
+		free(s.tiny);
 	if (iocb->close)
 		iocb->close(out->iocb.user);
+	TRACE_END(zone, "lbmLoad");
 	return res;
 }
 
@@ -569,4 +637,9 @@ void lbmFree(Lbm* out)
 		free(out->pixels);
 		out->pixels = NULL;
 	}
+	if (out->tiny)
+	{
+		free(out->tiny);
+		out->tiny = NULL;
+	}
 }
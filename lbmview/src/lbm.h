@@ -98,6 +98,10 @@ typedef struct Lbm
 	int16_t rangeRate[LBM_MAX_CRNG];
 	unsigned numRange;
 
+	// Deluxe Paint's embedded thumbnail, NULL if the file has none
+	int tinyW, tinyH;
+	uint8_t* tiny;
+
 } Lbm;
 
 #define LBM_CLEAR() (Lbm){  \
@@ -105,7 +109,9 @@ typedef struct Lbm
 	.customSub = NULL,      \
 	.customHndl = NULL,     \
 	.w = 0, .h = 0,         \
-	.pixels = NULL }
+	.pixels = NULL,         \
+	.tinyW = 0, .tinyH = 0, \
+	.tiny = NULL }
 
 int lbmLoad(Lbm* out);
 void lbmFree(Lbm* out);
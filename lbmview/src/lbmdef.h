@@ -13,6 +13,7 @@
 #define IFF_DRNG FOURCC('D', 'R', 'N', 'G')
 #define IFF_CCRT FOURCC('C', 'C', 'R', 'T')
 #define IFF_BODY FOURCC('B', 'O', 'D', 'Y')
+#define IFF_TINY FOURCC('T', 'I', 'N', 'Y')
 
 typedef struct
 {
@@ -94,4 +95,7 @@ typedef struct
 } LbmGraphicraftRange;
 #define CCRT_SIZE 14
 
+// DPaint thumbnail: width & height words, then pixels compressed the same as BODY
+#define TINY_HEAD_SIZE 4
+
 #endif//LBMDEF_H
@@ -1,6 +1,10 @@
 /* main.c - (C) 2023-2025 a dinosaur (zlib) */
 #include "display.h"
+#include "framestats.h"
+#include "gallery.h"
+#include "export.h"
 #include "audio.h"
+#include "trace.h"
 #include "util.h"
 #include <SDL3/SDL.h>
 #define SDL_MAIN_USE_CALLBACKS
@@ -18,6 +22,7 @@ static SizedStr title     = STR_CLEAR();
 static SizedStr audioPath = STR_CLEAR();
 
 static SizedBuf precompSpans = BUF_CLEAR();
+static int      precompSpansVer = 0;
 static SizedBuf oggv         = BUF_CLEAR();
 
 static uint8_t volume = 0;
@@ -25,11 +30,13 @@ static uint8_t volume = 0;
 #define IFF_CUSTOM_SCENE_INFO FOURCC('S', 'N', 'F', 'O')
 #define IFF_CUSTOM_OGG_VORBIS FOURCC('O', 'G', 'G', 'V')
 #define IFF_CUSTOM_SPANS      FOURCC('S', 'P', 'A', 'N')
+#define IFF_CUSTOM_SPANS2     FOURCC('S', 'P', 'N', '2')
 
 static int customSubscriber(IffFourCC fourcc)
 {
 	if (FOURCC_CMP(fourcc, IFF_CUSTOM_SCENE_INFO) ||
 		FOURCC_CMP(fourcc, IFF_CUSTOM_SPANS) ||
+		FOURCC_CMP(fourcc, IFF_CUSTOM_SPANS2) ||
 		FOURCC_CMP(fourcc, IFF_CUSTOM_OGG_VORBIS)) return 1;
 	return 0;
 }
@@ -80,7 +87,18 @@ MSVC_ENDNOWARN()
 	}
 	else if (FOURCC_CMP(fourcc, IFF_CUSTOM_SPANS))
 	{
+		// Multi-segment spans take precedence when both are present
+		if (precompSpansVer == 2)
+			return 0;
 		precompSpans = BUF_SIZED(chunk, size);
+		precompSpansVer = 1;
+		return 1;
+	}
+	else if (FOURCC_CMP(fourcc, IFF_CUSTOM_SPANS2))
+	{
+		BUF_FREE(precompSpans);
+		precompSpans = BUF_SIZED(chunk, size);
+		precompSpansVer = 2;
 		return 1;
 	}
 	else if (FOURCC_CMP(fourcc, IFF_CUSTOM_OGG_VORBIS))
@@ -96,27 +114,111 @@ static SDL_Window*   win  = NULL;
 static SDL_Renderer* rend = NULL;
 
 static Display* display = NULL;
+// Directories open as a grid of every image in them instead
+static Gallery* gallery = NULL;
 
 static char displayText[2048];
 static int  displayTextSplit;
 
 static bool realtime = false;
+static bool occluded = false;
+
+// Headless runs step a fixed clock for a set number of frames with no window at all
+static bool headless = false;
+static int  headlessRate = 60;
+static int  headlessFrames = 0;
+static int  headlessFrame = 0;
+static Exporter* exporter = NULL;
+
+// Benchmarks draw a set number of fixed-rate frames per cycle method as fast as they'll go
+static int benchFrames = 0;
+static int benchMethod = 0;
+static int benchFrame  = 0;
+static Uint64 benchStart;
+static FrameStats benchStats = FRAMESTATS_CLEAR();
+
+#ifdef ENABLE_TRACE
+// Trace events are written out on exit, or whenever F12 is pressed
+static const char* tracePath = "trace.json";
+
+static void dumpTrace(void)
+{
+	if (traceDump(tracePath))
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Failed to write trace to \"%s\"", tracePath);
+	else
+		SDL_Log("Wrote trace to \"%s\"", tracePath);
+}
+#endif
+
+// Timing HUD over the last few seconds of frames, the text only changes a few times a second
+#define HUD_FRAMES 240
+#define HUD_PERIOD (SDL_NS_PER_SECOND / 4)
+static bool hudShown = false;
+static char hudText[1024];
+static Uint64 hudUpdated = 0;
+static FrameStats hudStats = FRAMESTATS_CLEAR();
+static uint64_t lastStatsFrame = 0;
+
+// Speeds are exact ratios so scaled time never drifts from the real clock
+typedef struct { Uint64 num, den; } Timescale;
 
 #define TIMESCALE_NUM 15
-static const float speedTimescales[TIMESCALE_NUM] =
+static const Timescale speedTimescales[TIMESCALE_NUM] =
 {
-	0.01f, 0.0375f, 0.09f,
-	0.2f, 0.5f, 0.75f,
-	1.0f, 1.5f, 2.0f, 3.0f, 4.0f, 8.0f, 16.0f,
-	50.0f, 100.0f
+	{ 1, 100 }, { 3, 80 }, { 9, 100 },
+	{ 1, 5 }, { 1, 2 }, { 3, 4 },
+	{ 1, 1 }, { 3, 2 }, { 2, 1 }, { 3, 1 }, { 4, 1 }, { 8, 1 }, { 16, 1 },
+	{ 50, 1 }, { 100, 1 }
 };
+#define TIMESCALE(I) ((double)speedTimescales[I].num / (double)speedTimescales[I].den)
 
 static int speed = 6;
 
+// Animation time in nanoseconds at normal speed, the remainder carries what didn't divide evenly
+static Uint64 animClock = 0, animClockRem = 0;
+
+static const char* const methodNames[DISPLAY_CYCLEMETHOD_NUM] =
+{
+	[DISPLAY_CYCLEMETHOD_STEP]   = "Step",
+	[DISPLAY_CYCLEMETHOD_SRGB]   = "sRGB",
+	[DISPLAY_CYCLEMETHOD_LINEAR] = "Linear",
+	[DISPLAY_CYCLEMETHOD_HSLUV]  = "HSLuv",
+	[DISPLAY_CYCLEMETHOD_LAB]    = "CIELAB",
+	[DISPLAY_CYCLEMETHOD_OKLAB]  = "Oklab",
+	[DISPLAY_CYCLEMETHOD_OKLCH]  = "OkLCh"
+};
+
+// Also the file extensions recognised, besides .png for APNG
+static const char* const exportFormatNames[EXPORT_FORMAT_NUM] =
+{
+	[EXPORT_FORMAT_BGRA] = "bgra",
+	[EXPORT_FORMAT_Y4M]  = "y4m",
+	[EXPORT_FORMAT_GIF]  = "gif",
+	[EXPORT_FORMAT_APNG] = "apng"
+};
+
+// Indexed exports default to one whole loop, unless that would be absurdly long
+#define MAX_LOOP_SECONDS 600
+
 static void updateInteractiveDisplayText(void);
 static void setupDisplayText(const char* restrict lbmPath, const char* restrict displayTitle);
 static void playAudio(void);
 
+static int createWindow(const char* title, int w, int h)
+{
+	const int winflg = SDL_WINDOW_HIGH_PIXEL_DENSITY | SDL_WINDOW_RESIZABLE;
+	win = SDL_CreateWindow(title, w, h, winflg);
+#ifdef __APPLE__
+	// Force Metal on Apple, SDL_Gpu is buggy :(
+	const char* devName = "metal";
+#else
+	const char* devName = NULL;
+#endif
+	rend = SDL_CreateRenderer(win, devName);
+	SDL_SetRenderVSync(rend, 1);
+	return win && rend ? 0 : -1;
+}
+
 //FIXME: this has awful behaviour on load failure
 static int reset(const char* lbmPath)
 {
@@ -142,26 +244,16 @@ static int reset(const char* lbmPath)
 	}
 
 	const char* wintitle = STR_EMPTY(title) ? "Untitled" : title.ptr;
-	if (!win)
+	if (!win && !headless)
 	{
 		// Create window if it doesn't exist
-		const int winflg = SDL_WINDOW_HIGH_PIXEL_DENSITY | SDL_WINDOW_RESIZABLE;
-		win = SDL_CreateWindow(wintitle, lbm.w, lbm.h, winflg);
-#ifdef __APPLE__
-		// Force Metal on Apple, SDL_Gpu is buggy :(
-		const char* devName = "metal";
-#else
-		const char* devName = NULL;
-#endif
-		rend = SDL_CreateRenderer(win, devName);
-		SDL_SetRenderVSync(rend, 1);
-		if (!win || !rend)
+		if (createWindow(wintitle, lbm.w, lbm.h))
 		{
 			lbmFree(&lbm);
 			return -1;
 		}
 	}
-	else
+	else if (win)
 	{
 		SDL_SetWindowTitle(win, wintitle);
 		SDL_SetWindowSize(win, lbm.w, lbm.h);
@@ -169,14 +261,20 @@ static int reset(const char* lbmPath)
 
 	// Setup display
 	if (!display)
-		display = displayInit(rend, &lbm, precompSpans.ptr, precompSpans.len);
+		display = displayInit(rend, &lbm, precompSpans.ptr, precompSpans.len, precompSpansVer);
 	else
-		displayReset(display, &lbm, precompSpans.ptr, precompSpans.len);
-	displayContentScale(display, (double)SDL_GetWindowDisplayScale(win));
+		displayReset(display, &lbm, precompSpans.ptr, precompSpans.len, precompSpansVer);
+	animClock = animClockRem = 0;
+	if (win)
+		displayContentScale(display, (double)SDL_GetWindowDisplayScale(win));
 	lbmFree(&lbm);
 	if (!display)
 		return -1;
 	BUF_FREE(precompSpans);
+	precompSpansVer = 0;
+
+	if (headless)
+		return 0;
 
 	setupDisplayText(lbmPath, wintitle);
 
@@ -189,24 +287,16 @@ static void updateInteractiveDisplayText(void)
 {
 	if (displayTextSplit < 0)
 		return;
-	const char* methodName = NULL;
-	switch (displayGetCycleMethod(display))
-	{
-	case DISPLAY_CYCLEMETHOD_STEP:   methodName = "Step"; break;
-	case DISPLAY_CYCLEMETHOD_SRGB:   methodName = "sRGB"; break;
-	case DISPLAY_CYCLEMETHOD_LINEAR: methodName = "Linear"; break;
-	case DISPLAY_CYCLEMETHOD_HSLUV:  methodName = "HSLuv"; break;
-	case DISPLAY_CYCLEMETHOD_LAB:    methodName = "CIELAB"; break;
-	default:                         methodName = "?"; break;
-	}
+	const int method = displayGetCycleMethod(display);
+	const char* methodName = method >= 0 && method < DISPLAY_CYCLEMETHOD_NUM ? methodNames[method] : "?";
 
 	char speedTimescaleBuf[8];
 	snprintf(speedTimescaleBuf, sizeof(speedTimescaleBuf), "%.*f",
-		(int)sizeof(speedTimescaleBuf) - 3, speedTimescales[speed]);
+		(int)sizeof(speedTimescaleBuf) - 3, TIMESCALE(speed));
 	int numTimescaleChars = 0;
 	for (; speedTimescaleBuf[numTimescaleChars] != '\0' && speedTimescaleBuf[numTimescaleChars] != '.'; ++numTimescaleChars);
 	numTimescaleChars += 2;
-	if (speedTimescales[speed] < 1.0f)
+	if (speedTimescales[speed].num < speedTimescales[speed].den)
 	{
 		int i = sizeof(speedTimescaleBuf) - 2;
 		for (; i > numTimescaleChars && speedTimescaleBuf[i - 1] == '0'; --i);
@@ -214,14 +304,24 @@ static void updateInteractiveDisplayText(void)
 	}
 
 	const char* yes = "YES", * no = "NO";
+	const char* indexed = displayIsIndexed(display) ? yes
+		: displayIsIndexedWanted(display) ? "UNSUPPORTED" : no;
+	const char* pipelined = displayIsPipelined(display) ? yes
+		: displayIsPipelineWanted(display) ? "INACTIVE" : no;
 	snprintf(&displayText[displayTextSplit], sizeof(displayText) - (size_t)displayTextSplit,
 		"\nShow palette (P): %s\n"
 		"Show spans (S): %s\n"
 		"Cycle method (M): %s\n"
+		"Indexed texture (I): %s\n"
+		"Threaded frames (T): %s\n"
+		"Timing HUD (H): %s\n"
 		"Speed -([), +(]): %.*sx",
 		displayIsPaletteShown(display) ? yes : no,
 		displayIsSpanShown(display)    ? yes : no,
 		methodName,
+		indexed,
+		pipelined,
+		hudShown ? yes : no,
 		numTimescaleChars, speedTimescaleBuf);
 	displayShowText(display, displayText);
 }
@@ -273,19 +373,86 @@ void SDLCALL SDL_AppQuit(void *appstate, SDL_AppResult result)
 	STR_FREE(audioPath);
 	BUF_FREE(oggv);
 	STR_FREE(title);
+	exportClose(exporter);
+	frameStatsFree(&benchStats);
+	frameStatsFree(&hudStats);
 	displayFree(display);
+	galleryFree(gallery);
+#ifdef ENABLE_TRACE
+	// Every other traced thread has been joined by now
+	dumpTrace();
+	traceShutdown();
+#endif
 	BUF_FREE(precompSpans);
 	SDL_DestroyRenderer(rend);
 	SDL_DestroyWindow(win);
 	SDL_Quit();
 }
 
+static SDL_AppResult galleryEvent(const SDL_Event* event)
+{
+	if (event->type == SDL_EVENT_KEY_DOWN)
+	{
+		switch (event->key.scancode)
+		{
+		case SDL_SCANCODE_M:
+			gallerySetCycleMethod(gallery, (galleryGetCycleMethod(gallery) + 1) % DISPLAY_CYCLEMETHOD_NUM);
+			break;
+		case SDL_SCANCODE_LEFTBRACKET:
+			speed = MAX(0, speed - 1);
+			animClockRem = 0;
+			break;
+		case SDL_SCANCODE_RIGHTBRACKET:
+			speed = MIN(TIMESCALE_NUM - 1, speed + 1);
+			animClockRem = 0;
+			break;
+		case SDL_SCANCODE_UP:       galleryScroll(gallery, -1.0); break;
+		case SDL_SCANCODE_DOWN:     galleryScroll(gallery, 1.0); break;
+		case SDL_SCANCODE_PAGEUP:   galleryScroll(gallery, -4.0); break;
+		case SDL_SCANCODE_PAGEDOWN: galleryScroll(gallery, 4.0); break;
+		case SDL_SCANCODE_MINUS:    galleryZoom(gallery, 1); break;
+		case SDL_SCANCODE_EQUALS:   galleryZoom(gallery, -1); break;
+		default: break;
+		}
+	}
+	else if (event->type == SDL_EVENT_MOUSE_WHEEL)
+	{
+		galleryScroll(gallery, (double)-event->wheel.y * 0.5);
+	}
+	else if (event->type == SDL_EVENT_WINDOW_PIXEL_SIZE_CHANGED)
+	{
+		galleryResize(gallery, event->window.data1, event->window.data2);
+	}
+	else if (event->type == SDL_EVENT_WINDOW_EXPOSED ||
+		event->type == SDL_EVENT_WINDOW_RESTORED ||
+		event->type == SDL_EVENT_WINDOW_SHOWN)
+	{
+		occluded = false;
+	}
+	else if (event->type == SDL_EVENT_WINDOW_OCCLUDED ||
+		event->type == SDL_EVENT_WINDOW_MINIMIZED ||
+		event->type == SDL_EVENT_WINDOW_HIDDEN)
+	{
+		occluded = true;
+	}
+	return SDL_APP_CONTINUE;
+}
+
 SDL_AppResult SDLCALL SDL_AppEvent(void* appstate, SDL_Event* event)
 {
 	(void)appstate;
 
 	if (event->type == SDL_EVENT_QUIT)
 		return SDL_APP_SUCCESS;
+#ifdef ENABLE_TRACE
+	if (event->type == SDL_EVENT_KEY_DOWN && event->key.scancode == SDL_SCANCODE_F12)
+	{
+		dumpTrace();
+		return SDL_APP_CONTINUE;
+	}
+#endif
+	if (gallery)
+		return galleryEvent(event);
 
 	if (event->type == SDL_EVENT_KEY_DOWN)
 	{
@@ -309,16 +476,38 @@ SDL_AppResult SDLCALL SDL_AppEvent(void* appstate, SDL_Event* event)
 			displayCycleBlendMethod(display);
 			updateInteractiveDisplayText();
 		}
+		else if (event->key.scancode == SDL_SCANCODE_I)
+		{
+			displayToggleIndexed(display);
+			updateInteractiveDisplayText();
+		}
+		else if (event->key.scancode == SDL_SCANCODE_T)
+		{
+			displayTogglePipelined(display);
+			updateInteractiveDisplayText();
+		}
+		else if (event->key.scancode == SDL_SCANCODE_H)
+		{
+			hudShown = !hudShown && (hudStats.frames || !frameStatsInit(&hudStats, HUD_FRAMES));
+			frameStatsReset(&hudStats);
+			displayGetFrameStats(display, &lastStatsFrame);
+			hudUpdated = 0;
+			SDL_strlcpy(hudText, "Timing frames...", sizeof(hudText));
+			displayShowHud(display, hudShown ? hudText : NULL);
+			updateInteractiveDisplayText();
+		}
 		else if (event->key.scancode == SDL_SCANCODE_LEFTBRACKET)
 		{
 			if (speed > 0)
 				--speed;
+			animClockRem = 0;
 			updateInteractiveDisplayText();
 		}
 		else if (event->key.scancode == SDL_SCANCODE_RIGHTBRACKET)
 		{
 			if (speed < TIMESCALE_NUM - 1)
 				++speed;
+			animClockRem = 0;
 			updateInteractiveDisplayText();
 		}
 	}
@@ -332,8 +521,20 @@ SDL_AppResult SDLCALL SDL_AppEvent(void* appstate, SDL_Event* event)
 	}
 	else if (event->type == SDL_EVENT_WINDOW_EXPOSED)
 	{
-		if (!realtime)
-			displayDamage(display);
+		occluded = false;
+		displayDamage(display);
+	}
+	else if (event->type == SDL_EVENT_WINDOW_OCCLUDED ||
+		event->type == SDL_EVENT_WINDOW_MINIMIZED ||
+		event->type == SDL_EVENT_WINDOW_HIDDEN)
+	{
+		occluded = true;
+	}
+	else if (event->type == SDL_EVENT_WINDOW_RESTORED ||
+		event->type == SDL_EVENT_WINDOW_SHOWN)
+	{
+		occluded = false;
+		displayDamage(display);
 	}
 	else if (event->type == SDL_EVENT_DROP_FILE)
 	{
@@ -348,10 +549,160 @@ static Uint64 tick;
 
 #define USE_PERFORMANCE_COUNTER 0
 
+// Moves the animation clock on by the real time since the last call at the current speed
+static Uint64 advanceClock(void)
+{
+	const Uint64 lastTick = tick;
+#if USE_PERFORMANCE_COUNTER
+	tick = SDL_GetPerformanceCounter();
+	const Uint64 dTick = (Uint64)((double)(tick - lastTick) * 1e9 / (double)SDL_GetPerformanceFrequency());
+#else
+	tick = SDL_GetTicksNS();
+	const Uint64 dTick = tick - lastTick;
+#endif
+	const Timescale ts = speedTimescales[speed];
+	const Uint64 scaled = dTick * ts.num + animClockRem;
+	animClock += scaled / ts.den;
+	animClockRem = scaled % ts.den;
+	return dTick;
+}
+
+static SDL_AppResult galleryIterate(void)
+{
+#ifndef EMSCRIPTEN
+	// Nothing to do but wait while hidden, the tiles seek straight to the clock after
+	if (occluded)
+		SDL_WaitEventTimeout(NULL, -1);
+#endif
+	advanceClock();
+	gallerySeek(gallery, animClock);
+	if (!occluded)
+		galleryRepaint(gallery);
+	return SDL_APP_CONTINUE;
+}
+
+// Frame i shows the clock at i / headlessRate, so runs are reproducible,
+//  rounded up to the nanosecond so steps landing exactly on a frame aren't missed
+static Uint64 frameClock(int frame)
+{
+	const Timescale ts = speedTimescales[speed];
+	const Uint64 frameDen = (Uint64)headlessRate * ts.den;
+	return ((Uint64)frame * ts.num * SDL_NS_PER_SECOND + frameDen - 1) / frameDen;
+}
+
+// Adds the display's last frame if it's drawn one since, true if it had
+static bool collectFrameStats(FrameStats* fs)
+{
+	uint64_t frames = 0;
+	const DisplayFrameStats* stats = displayGetFrameStats(display, &frames);
+	if (!stats || frames == lastStatsFrame)
+		return false;
+	lastStatsFrame = frames;
+	frameStatsAdd(fs, stats);
+	return true;
+}
+
+static void updateHud(void)
+{
+	if (!hudShown || !collectFrameStats(&hudStats))
+		return;
+	const Uint64 now = SDL_GetTicksNS();
+	if (now - hudUpdated < HUD_PERIOD)
+		return;
+	hudUpdated = now;
+	frameStatsFormat(&hudStats, hudText, sizeof(hudText));
+	displayShowHud(display, hudText);
+}
+
+static SDL_AppResult benchIterate(void)
+{
+	if (benchFrame == 0)
+	{
+		displaySetCycleMethod(display, benchMethod);
+		frameStatsReset(&benchStats);
+		displayGetFrameStats(display, &lastStatsFrame);
+		benchStart = SDL_GetTicksNS();
+	}
+	displaySeek(display, frameClock(benchFrame));
+	displayRepaint(display);
+	collectFrameStats(&benchStats);
+	if (++benchFrame < benchFrames)
+		return SDL_APP_CONTINUE;
+
+	// Step mode only draws the frames a range stepped on
+	const double elapsed = (double)(SDL_GetTicksNS() - benchStart) / 1000000.0;
+	char table[1024];
+	frameStatsFormat(&benchStats, table, sizeof(table));
+	SDL_Log("%s: %d frames (%d drawn) in %.1fms, %.1f fps\n%s\n", methodNames[benchMethod],
+		benchFrames, benchStats.num, elapsed, (double)benchFrames * 1000.0 / elapsed, table);
+	benchFrame = 0;
+	return ++benchMethod < DISPLAY_CYCLEMETHOD_NUM ? SDL_APP_CONTINUE : SDL_APP_SUCCESS;
+}
+
+static SDL_AppResult headlessIterate(void)
+{
+	if (headlessFrame == 0)
+		tick = SDL_GetTicksNS();
+
+	displaySeek(display, frameClock(headlessFrame));
+	displayRepaint(display);
+	if (exporter)
+	{
+		int w, h, numDirty;
+		const SurfRect* dirty = displayGetFrameDirty(display, &numDirty);
+		int err;
+		if (exportIsIndexed(exporter))
+		{
+			const Colour* pal = NULL;
+			const uint8_t* pix = displayGetFrameIndexed(display, &pal, &w, &h);
+			err = exportIndexedFrame(exporter, pix, pal, dirty, numDirty);
+		}
+		else
+		{
+			err = exportFrame(exporter, displayGetFrame(display, &w, &h), dirty, numDirty);
+		}
+		if (err)
+		{
+			SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Failed to write frame %d", headlessFrame);
+			return SDL_APP_FAILURE;
+		}
+	}
+	if (++headlessFrame < headlessFrames)
+		return SDL_APP_CONTINUE;
+
+	if (exporter)
+	{
+		const int err = exportClose(exporter);
+		exporter = NULL;
+		if (err)
+		{
+			SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Failed to finish export");
+			return SDL_APP_FAILURE;
+		}
+	}
+
+	const double elapsed = (double)(SDL_GetTicksNS() - tick) / 1000000.0;
+	int w = 0, h = 0;
+	const Colour* frame = displayGetFrame(display, &w, &h);
+	uint64_t hash = 0xCBF29CE484222325ULL;
+	for (size_t i = 0; frame && i < (size_t)w * (size_t)h; ++i)
+		hash = (hash ^ frame[i]) * 0x100000001B3ULL;
+	SDL_Log("%d frames of %dx%d in %.1fms (%.3fms/frame), last frame %016" SDL_PRIx64,
+		headlessFrames, w, h, elapsed, elapsed / headlessFrames, hash);
+	return SDL_APP_SUCCESS;
+}
+
 SDL_AppResult SDLCALL SDL_AppIterate(void* appstate)
 {
 	(void)appstate;
 
+	if (benchFrames > 0)
+		return benchIterate();
+	if (headless)
+		return headlessIterate();
+	if (gallery)
+		return galleryIterate();
+
 	bool realtimeNew = !BUF_EMPTY(precompSpans) || displayHasAnimation(display) || displayIsTextShown(display);
 	if (!realtime == realtimeNew)
 	{
@@ -368,21 +719,24 @@ SDL_AppResult SDLCALL SDL_AppIterate(void* appstate)
 
 	if (realtime)
 	{
-		const Uint64 lastTick = tick;
-#if USE_PERFORMANCE_COUNTER
-		const double divisor = (double)SDL_GetPerformanceFrequency();
-		tick = SDL_GetPerformanceCounter();
-#else
-		const double divisor = 1000000000.0;
-		tick = SDL_GetTicksNS();
+#ifndef EMSCRIPTEN
+		// Sleep until the picture next changes (or forever while hidden), events cut the wait short
+		const double wait = occluded ? INFINITY : displayTimeToNextChange(display, TIMESCALE(speed));
+		if (wait > 0.0)
+			SDL_WaitEventTimeout(NULL, isinf(wait) ? -1 : (Sint32)MIN(ceil(wait * 1000.0), (double)INT32_MAX));
 #endif
-		const double dTick = (double)(tick - lastTick) / divisor;
-		displayUpdateTimer(display, (double)speedTimescales[speed] * dTick);
-		displayUpdateTextDisplay(display, dTick);
-		displayDamage(display);
+
+		const Uint64 dTick = advanceClock();
+		displaySeek(display, animClock);
+		displayUpdateTextDisplay(display, (double)dTick / 1e9);
 	}
 
-	displayRepaint(display);
+	// The clock keeps running while hidden, the palette catches up once visible again
+	if (!occluded)
+	{
+		displayRepaint(display);
+		updateHud();
+	}
 
 	return SDL_APP_CONTINUE;
 }
@@ -403,6 +757,7 @@ static void openFileDialogue(void* user, const char* const* list, int filter)
 SDL_AppResult SDLCALL SDL_AppInit(void** appstate, int argc, char* argv[])
 {
 	(void)appstate;
+	TRACE_THREAD("main");
 
 #ifndef EMSCRIPTEN
 	// Open file picker when no arguments are provided
@@ -440,17 +795,142 @@ SDL_AppResult SDLCALL SDL_AppInit(void** appstate, int argc, char* argv[])
 	}
 #endif
 
-	if (argc != 2)
+	const char* lbmPath = NULL, * exportPath = NULL;
+	int exportFormat = -1, method = -1;
+	double seconds = 0.0;
+	bool usage = false;
+	for (int i = 1; i < argc && !usage; ++i)
+	{
+		const bool hasValue = i + 1 < argc;
+		if (!SDL_strcmp(argv[i], "--headless"))
+			headless = true;
+		else if (!SDL_strcmp(argv[i], "--frames") && hasValue)
+			headlessFrames = SDL_atoi(argv[++i]);
+		else if (!SDL_strcmp(argv[i], "--seconds") && hasValue)
+			seconds = SDL_atof(argv[++i]);
+		else if (!SDL_strcmp(argv[i], "--fps") && hasValue)
+			headlessRate = SDL_atoi(argv[++i]);
+		else if (!SDL_strcmp(argv[i], "--bench") && hasValue)
+		{
+			benchFrames = SDL_atoi(argv[++i]);
+			usage = benchFrames <= 0;
+		}
+		else if (!SDL_strcmp(argv[i], "--export") && hasValue)
+		{
+			exportPath = argv[++i];
+			headless = true;
+		}
+		else if (!SDL_strcmp(argv[i], "--format") && hasValue)
+		{
+			++i;
+			for (exportFormat = EXPORT_FORMAT_NUM - 1; exportFormat >= 0 && SDL_strcasecmp(argv[i], exportFormatNames[exportFormat]); --exportFormat);
+			usage = exportFormat < 0;
+		}
+		else if (!SDL_strcmp(argv[i], "--method") && hasValue)
+		{
+			++i;
+			for (method = DISPLAY_CYCLEMETHOD_NUM - 1; method >= 0 && SDL_strcasecmp(argv[i], methodNames[method]); --method);
+			usage = method < 0;
+		}
+#ifdef ENABLE_TRACE
+		else if (!SDL_strcmp(argv[i], "--trace") && hasValue)
+			tracePath = argv[++i];
+#endif
+		else if (argv[i][0] != '-' && !lbmPath)
+			lbmPath = argv[i];
+		else
+			usage = true;
+	}
+	SDL_PathInfo pathInfo;
+	const bool isDir = lbmPath && SDL_GetPathInfo(lbmPath, &pathInfo) && pathInfo.type == SDL_PATHTYPE_DIRECTORY;
+	if (usage || !lbmPath || headlessRate <= 0 || (isDir && (headless || benchFrames)) || (exportPath && benchFrames))
+	{
+		SDL_Log("Usage: %s [options] <file.lbm | directory>\n"
+			"  --method NAME      Cycle method (Step, sRGB, Linear, HSLuv, CIELAB, Oklab, OkLCh)\n"
+			"  --headless         Render without a window\n"
+			"  --export PATH      Write frames to PATH (- for stdout), implies --headless\n"
+			"  --format FORMAT    Export as bgra (raw), y4m, gif or apng, by default from the extension\n"
+			"  --fps N            Headless frame rate (default 60)\n"
+			"  --frames N         Headless frames to render (default 10 seconds' worth, or one loop for gif & apng)\n"
+			"  --seconds S        Headless duration in seconds\n"
+			"  --bench N          Time N frames at --fps with each cycle method, vsync off, then quit"
+#ifdef ENABLE_TRACE
+			"\n  --trace PATH       Write trace events to PATH on exit & with F12 (default trace.json)"
+#endif
+			, argv[0]);
 		return SDL_APP_FAILURE;
+	}
+	if (exportPath && exportFormat < 0)
+	{
+		const char* ext = SDL_strrchr(exportPath, '.');
+		exportFormat = EXPORT_FORMAT_BGRA;
+		for (int i = 0; ext && i < EXPORT_FORMAT_NUM; ++i)
+			if (!SDL_strcasecmp(&ext[1], exportFormatNames[i]))
+				exportFormat = i;
+		if (ext && !SDL_strcasecmp(ext, ".png"))
+			exportFormat = EXPORT_FORMAT_APNG;
+	}
 
 #ifndef EMSCRIPTEN
-	SDL_SetHint(SDL_HINT_MAIN_CALLBACK_RATE, "waitevent");
+	// Headless & benchmark frames run back to back, the gallery always has something cycling
+	SDL_SetHint(SDL_HINT_MAIN_CALLBACK_RATE, headless || benchFrames ? "0" : isDir ? NULL : "waitevent");
 #endif
-	if (!SDL_Init(SDL_INIT_VIDEO))
+	if (!SDL_Init(headless ? 0 : SDL_INIT_VIDEO))
 		return SDL_APP_FAILURE;
 
-	if (reset(argv[1]))
+	if (isDir)
+	{
+		if (createWindow(lbmPath, 1280, 800) || !(gallery = galleryInit(rend, lbmPath)))
+		{
+			SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "No images could be shown from \"%s\"", lbmPath);
+			return SDL_APP_FAILURE;
+		}
+		if (method >= 0)
+			gallerySetCycleMethod(gallery, method);
+		SDL_Log("Showing %d images", galleryNumTiles(gallery));
+		goto SkipCommandLineInit;
+	}
+
+	if (reset(lbmPath))
 		return SDL_APP_FAILURE;
+	if (benchFrames)
+	{
+		// Every frame gets drawn as soon as the last is done, rather than waiting on the display
+		if (rend)
+			SDL_SetRenderVSync(rend, 0);
+		if (frameStatsInit(&benchStats, benchFrames))
+			return SDL_APP_FAILURE;
+		SDL_Log("Benchmarking %d frames at %d fps", benchFrames, headlessRate);
+	}
+	if (method >= 0)
+	{
+		displaySetCycleMethod(display, method);
+		if (!headless)
+			updateInteractiveDisplayText();
+	}
+
+	if (exportPath)
+	{
+		int w, h;
+		displayGetFrame(display, &w, &h);
+		exporter = exportOpen(exportPath, exportFormat, w, h, headlessRate);
+		if (!exporter)
+		{
+			SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Failed to open \"%s\" for export", exportPath);
+			return SDL_APP_FAILURE;
+		}
+	}
+	if (headlessFrames <= 0 && seconds <= 0.0 && exportIsIndexed(exporter))
+	{
+		// Animations loop on their own, so one trip round every range is enough
+		const double period = displayLoopPeriod(display) / TIMESCALE(speed);
+		if (period <= MAX_LOOP_SECONDS)
+			headlessFrames = MAX(1, (int)round(period * headlessRate));
+		else
+			SDL_Log("Loop is longer than %d seconds, it won't repeat seamlessly", MAX_LOOP_SECONDS);
+	}
+	if (headlessFrames <= 0)
+		headlessFrames = MAX(1, (int)ceil((seconds > 0.0 ? seconds : 10.0) * headlessRate));
 
 SkipCommandLineInit:
 #if USE_PERFORMANCE_COUNTER
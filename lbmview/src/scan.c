@@ -0,0 +1,154 @@
+/* scan.c - (C) 2025 a dinosaur (zlib) */
+#include "scan.h"
+#include "util.h"
+#include <SDL3/SDL_cpuinfo.h>
+#include <SDL3/SDL_mutex.h>
+#include <SDL3/SDL_stdinc.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+# define SCAN_HAVE_AVX2
+# include <immintrin.h>
+# if defined(__GNUC__) || defined(__clang__)
+#  define TARGET_AVX2 __attribute__((target("avx2")))
+# else
+#  define TARGET_AVX2
+# endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+# define SCAN_HAVE_NEON
+# include <arm_neon.h>
+#endif
+
+
+typedef void (*ScanRowKernel)(uint64_t* restrict bits, const uint8_t* restrict src, const ScanSet* set, size_t len);
+
+static inline uint64_t FORCE_INLINE classifyScalar(const uint8_t* restrict src, const ScanSet* set, size_t len)
+{
+	uint64_t word = 0;
+	for (size_t i = 0; i < len; ++i)
+		word |= (uint64_t)set->member[src[i]] << i;
+	return word;
+}
+
+static void scanRowScalar(uint64_t* restrict bits, const uint8_t* restrict src, const ScanSet* set, size_t len)
+{
+	for (size_t i = 0; i < len; i += 64)
+		*bits++ = classifyScalar(&src[i], set, MIN(len - i, 64));
+}
+
+#ifdef SCAN_HAVE_AVX2
+TARGET_AVX2 static inline uint32_t classifyAvx2(__m256i v, __m256i lowHiClear, __m256i lowHiSet, __m256i hiBit)
+{
+	// pshufb yields zero for indices with the top bit set, which splits the lookup into two halves
+	const __m256i inClear = _mm256_shuffle_epi8(lowHiClear, v);
+	const __m256i inSet = _mm256_shuffle_epi8(lowHiSet, _mm256_xor_si256(v, _mm256_set1_epi8((char)0x80)));
+	const __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x07));
+	const __m256i hit = _mm256_and_si256(_mm256_or_si256(inClear, inSet), _mm256_shuffle_epi8(hiBit, hi));
+	return ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hit, _mm256_setzero_si256()));
+}
+
+TARGET_AVX2 static void scanRowAvx2(uint64_t* restrict bits, const uint8_t* restrict src, const ScanSet* set, size_t len)
+{
+	const __m256i lowHiClear = _mm256_broadcastsi128_si256(_mm_loadu_si128((const void*)set->lowHiClear));
+	const __m256i lowHiSet = _mm256_broadcastsi128_si256(_mm_loadu_si128((const void*)set->lowHiSet));
+	const __m256i hiBit = _mm256_setr_epi8(
+		1, 2, 4, 8, 16, 32, 64, (char)128, 1, 2, 4, 8, 16, 32, 64, (char)128,
+		1, 2, 4, 8, 16, 32, 64, (char)128, 1, 2, 4, 8, 16, 32, 64, (char)128);
+
+	size_t i = 0;
+	for (; i + 64 <= len; i += 64)
+	{
+		const uint32_t lo = classifyAvx2(_mm256_loadu_si256((const void*)&src[i]), lowHiClear, lowHiSet, hiBit);
+		const uint32_t hi = classifyAvx2(_mm256_loadu_si256((const void*)&src[i + 32]), lowHiClear, lowHiSet, hiBit);
+		*bits++ = (uint64_t)hi << 32 | lo;
+	}
+	if (i < len)
+		*bits = classifyScalar(&src[i], set, len - i);
+}
+#endif
+
+#ifdef SCAN_HAVE_NEON
+static inline uint16_t classifyNeon(uint8x16_t v, uint8x16_t lowHiClear, uint8x16_t lowHiSet, uint8x16_t hiBit)
+{
+	// tbl yields zero for out of range indices, keeping the top bit splits the lookup into two halves
+	const uint8x16_t inClear = vqtbl1q_u8(lowHiClear, vandq_u8(v, vdupq_n_u8(0x8F)));
+	const uint8x16_t inSet = vqtbl1q_u8(lowHiSet, vandq_u8(veorq_u8(v, vdupq_n_u8(0x80)), vdupq_n_u8(0x8F)));
+	const uint8x16_t hi = vandq_u8(vshrq_n_u8(v, 4), vdupq_n_u8(0x07));
+	const uint8x16_t hit = vandq_u8(vorrq_u8(inClear, inSet), vqtbl1q_u8(hiBit, hi));
+
+	// Gather one bit per lane into a mask
+	const uint8x16_t lane = vandq_u8(vtstq_u8(hit, hit), hiBit);
+	return (uint16_t)(vaddv_u8(vget_low_u8(lane)) | vaddv_u8(vget_high_u8(lane)) << 8);
+}
+
+static void scanRowNeon(uint64_t* restrict bits, const uint8_t* restrict src, const ScanSet* set, size_t len)
+{
+	const uint8x16_t lowHiClear = vld1q_u8(set->lowHiClear);
+	const uint8x16_t lowHiSet = vld1q_u8(set->lowHiSet);
+	static const uint8_t hiBitTbl[16] = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+	const uint8x16_t hiBit = vld1q_u8(hiBitTbl);
+
+	size_t i = 0;
+	for (; i + 64 <= len; i += 64)
+	{
+		uint64_t word = 0;
+		for (unsigned k = 0; k < 4; ++k)
+			word |= (uint64_t)classifyNeon(vld1q_u8(&src[i + k * 16]), lowHiClear, lowHiSet, hiBit) << (k * 16);
+		*bits++ = word;
+	}
+	if (i < len)
+		*bits = classifyScalar(&src[i], set, len - i);
+}
+#endif
+
+
+void scanBuildSet(ScanSet* set, const bool members[256])
+{
+	SDL_memset(set, 0, sizeof(ScanSet));
+	for (unsigned p = 0; p < 256; ++p)
+	{
+		if (!members[p])
+			continue;
+		set->member[p] = 1;
+		if (p < 0x80)
+			set->lowHiClear[p & 0xF] |= (uint8_t)(1U << (p >> 4));
+		else
+			set->lowHiSet[p & 0xF] |= (uint8_t)(1U << ((p >> 4) - 8));
+	}
+}
+
+
+static ScanRowKernel rowKernel = scanRowScalar;
+static const char* rowKernelName = "Scalar";
+
+// Surfaces can be set up from worker threads, so the kernel is only ever picked once
+void scanInit(void)
+{
+	static SDL_InitState init;
+	if (!SDL_ShouldInit(&init))
+		return;
+#ifdef SCAN_HAVE_AVX2
+	if (SDL_HasAVX2())
+	{
+		rowKernel = scanRowAvx2;
+		rowKernelName = "AVX2";
+	}
+#endif
+#ifdef SCAN_HAVE_NEON
+	if (SDL_HasNEON())
+	{
+		rowKernel = scanRowNeon;
+		rowKernelName = "NEON";
+	}
+#endif
+	SDL_SetInitialized(&init, true);
+}
+
+const char* scanKernelName(void)
+{
+	return rowKernelName;
+}
+
+void scanClassifyRow(uint64_t* restrict bits, const uint8_t* restrict src, const ScanSet* set, size_t len)
+{
+	rowKernel(bits, src, set, len);
+}
@@ -0,0 +1,23 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+typedef struct ScanSet
+{
+	uint8_t member[256];
+	// Members split by low nibble, as masks of the high nibbles 0-7 & 8-15
+	uint8_t lowHiClear[16], lowHiSet[16];
+} ScanSet;
+
+void scanInit(void);
+const char* scanKernelName(void);
+
+void scanBuildSet(ScanSet* set, const bool members[256]);
+
+// Set bit i of bits for every src[i] that is in the set, bits must hold len rounded up to 64
+void scanClassifyRow(uint64_t* restrict bits, const uint8_t* restrict src, const ScanSet* set, size_t len);
+
+#endif//SCAN_H
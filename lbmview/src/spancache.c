@@ -0,0 +1,276 @@
+/* spancache.c - (C) 2025 a dinosaur (zlib) */
+#include "spancache.h"
+#include "util.h"
+#include <SDL3/SDL.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+
+// The cache is trimmed back under these after a store pushes it over
+#define SPAN_CACHE_MAX_BYTES (32 << 20)
+#define SPAN_CACHE_MAX_FILES 1024
+// Entries bigger than this would churn the rest out of the cache
+#define SPAN_CACHE_MAX_ENTRY (SPAN_CACHE_MAX_BYTES / 16)
+// Hits only refresh an entry's age once it's this old, so loads don't always write
+#define SPAN_CACHE_TOUCH_NS (SDL_NS_PER_SECOND * 60 * 60)
+
+// Bump whenever the span builder's output changes, to invalidate old entries
+#define SPAN_CACHE_VERSION 1
+
+typedef struct
+{
+	char     magic[4];
+	uint32_t version;
+	int32_t  w, h;
+	uint64_t key;
+} SpanCacheHeader;
+
+static const char spanCacheMagic[4] = { 'L', 'S', 'P', 'C' };
+
+
+#define HASH_PRIME1 0x9E3779B185EBCA87ULL
+#define HASH_PRIME2 0xC2B2AE3D27D4EB4FULL
+#define HASH_PRIME3 0x165667B19E3779F9ULL
+
+static inline uint64_t FORCE_INLINE rotl64(uint64_t v, int s) { return v << s | v >> (64 - s); }
+
+static inline uint64_t FORCE_INLINE hashRound(uint64_t acc, uint64_t v)
+{
+	return rotl64(acc + v * HASH_PRIME2, 31) * HASH_PRIME1;
+}
+
+static uint64_t hashFinal(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= HASH_PRIME2;
+	h ^= h >> 29;
+	h *= HASH_PRIME3;
+	return h ^ (h >> 32);
+}
+
+// Four independent lanes keep the multiplies from serialising on large images
+static uint64_t hashBytes(uint64_t seed, const uint8_t* p, size_t len)
+{
+	uint64_t acc[4] = { seed + HASH_PRIME1 + HASH_PRIME2, seed + HASH_PRIME2, seed, seed - HASH_PRIME1 };
+	size_t i = 0;
+	for (; i + 32 <= len; i += 32)
+	{
+		uint64_t v[4];
+		SDL_memcpy(v, &p[i], sizeof(v));
+		for (unsigned k = 0; k < 4; ++k)
+			acc[k] = hashRound(acc[k], v[k]);
+	}
+	uint64_t h = rotl64(acc[0], 1) + rotl64(acc[1], 7) + rotl64(acc[2], 12) + rotl64(acc[3], 18) + len;
+	for (; i + 8 <= len; i += 8)
+	{
+		uint64_t v;
+		SDL_memcpy(&v, &p[i], sizeof(v));
+		h = hashRound(h, v);
+	}
+	for (; i < len; ++i)
+		h = hashRound(h, p[i]);
+	return h;
+}
+
+uint64_t spanCacheKey(const Surface* surf,
+	const uint8_t hi[], const uint8_t low[],
+	const int16_t rate[], int numRanges)
+{
+	uint64_t h = hashBytes(SPAN_CACHE_VERSION, surf->srcPix, (size_t)surf->w * (size_t)surf->h);
+	h = hashRound(h, (uint64_t)(uint32_t)surf->w << 32 | (uint32_t)surf->h);
+	for (int i = 0; i < numRanges; ++i)
+		h = hashRound(h, (uint64_t)hi[i] << 24 | (uint64_t)low[i] << 16 | (uint16_t)rate[i]);
+	return hashFinal(hashRound(h, (uint64_t)numRanges));
+}
+
+
+static char* cacheDir = NULL;
+static bool  cacheDirTried = false;
+
+static const char* getCacheDir(void)
+{
+	if (cacheDirTried)
+		return cacheDir;
+	cacheDirTried = true;
+
+#ifndef __EMSCRIPTEN__
+	// Follow the XDG base directory spec where set, otherwise the platform's usual spot
+	const char* xdg = SDL_getenv("XDG_CACHE_HOME");
+	const char* home = SDL_getenv("HOME");
+	int len = -1;
+	if (xdg && *xdg)
+		len = SDL_asprintf(&cacheDir, "%s/lbmview/spans/", xdg);
+	else if (home && *home)
+#ifdef __APPLE__
+		len = SDL_asprintf(&cacheDir, "%s/Library/Caches/lbmview/spans/", home);
+#else
+		len = SDL_asprintf(&cacheDir, "%s/.cache/lbmview/spans/", home);
+#endif
+	else
+	{
+		char* pref = SDL_GetPrefPath(NULL, "lbmview");
+		if (pref)
+			len = SDL_asprintf(&cacheDir, "%sspans/", pref);
+		SDL_free(pref);
+	}
+
+	if (len < 0)
+		cacheDir = NULL;
+	else if (!SDL_CreateDirectory(cacheDir))
+	{
+		SDL_free(cacheDir);
+		cacheDir = NULL;
+	}
+#endif
+	return cacheDir;
+}
+
+static char* entryPath(uint64_t key)
+{
+	const char* dir = getCacheDir();
+	char* path = NULL;
+	if (!dir || SDL_asprintf(&path, "%s%016" SDL_PRIx64 ".spn", dir, key) < 0)
+		return NULL;
+	return path;
+}
+
+// Written aside & renamed into place so another instance never reads a partial entry
+static bool writeEntry(const char* path, const void* data, size_t size)
+{
+	char* temp = NULL;
+	if (SDL_asprintf(&temp, "%s.tmp", path) < 0)
+		return false;
+	const bool ok = SDL_SaveFile(temp, data, size) && SDL_RenamePath(temp, path);
+	if (!ok)
+		SDL_RemovePath(temp);
+	SDL_free(temp);
+	return ok;
+}
+
+int spanCacheLoad(Surface* surf, uint64_t key)
+{
+	if (!surf)
+		return -1;
+	char* path = entryPath(key);
+	if (!path)
+		return -1;
+
+	size_t size = 0;
+	uint8_t* data = SDL_LoadFile(path, &size);
+	int res = -1;
+	if (data && size > sizeof(SpanCacheHeader))
+	{
+		SpanCacheHeader head;
+		SDL_memcpy(&head, data, sizeof(SpanCacheHeader));
+		if (!SDL_memcmp(head.magic, spanCacheMagic, sizeof(spanCacheMagic)) &&
+			head.version == SPAN_CACHE_VERSION && head.key == key &&
+			head.w == surf->w && head.h == surf->h)
+			res = surfaceLoadSpans2(surf, data + sizeof(SpanCacheHeader), size - sizeof(SpanCacheHeader));
+	}
+
+	if (!res)
+	{
+		// Rewriting the entry bumps its modification time, which eviction orders by,
+		//  & it goes through a rename like any store so readers only ever see whole entries
+		SDL_PathInfo info;
+		SDL_Time now;
+		if (SDL_GetPathInfo(path, &info) && SDL_GetCurrentTime(&now) && now - info.modify_time > SPAN_CACHE_TOUCH_NS)
+			writeEntry(path, data, size);
+	}
+	else if (data)
+	{
+		// Stale or corrupt, drop it so it gets replaced
+		SDL_RemovePath(path);
+	}
+
+	SDL_free(data);
+	SDL_free(path);
+	return res;
+}
+
+
+typedef struct { const char* name; SDL_Time time; Uint64 size; } CacheEntry;
+
+static int SDLCALL compareEntryAge(const void* lhs, const void* rhs)
+{
+	const SDL_Time l = ((const CacheEntry*)lhs)->time, r = ((const CacheEntry*)rhs)->time;
+	return (l > r) - (l < r);
+}
+
+static void trimCache(const char* dir)
+{
+	int count = 0;
+	char** names = SDL_GlobDirectory(dir, "*.spn", 0, &count);
+	if (!names)
+		return;
+	CacheEntry* entries = count > 0 ? malloc(sizeof(CacheEntry) * (size_t)count) : NULL;
+	if (!entries)
+	{
+		SDL_free(names);
+		return;
+	}
+
+	Uint64 total = 0;
+	int num = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		char* path = NULL;
+		SDL_PathInfo info;
+		if (SDL_asprintf(&path, "%s%s", dir, names[i]) < 0)
+			continue;
+		if (SDL_GetPathInfo(path, &info) && info.type == SDL_PATHTYPE_FILE)
+		{
+			entries[num++] = (CacheEntry){ names[i], info.modify_time, info.size };
+			total += info.size;
+		}
+		SDL_free(path);
+	}
+
+	if (total > SPAN_CACHE_MAX_BYTES || num > SPAN_CACHE_MAX_FILES)
+	{
+		// Evict least recently used first, down to 3/4 of the limits so every store doesn't sweep
+		SDL_qsort(entries, (size_t)num, sizeof(CacheEntry), compareEntryAge);
+		for (int i = 0; i < num; ++i)
+		{
+			if (total <= SPAN_CACHE_MAX_BYTES / 4 * 3 && num - i <= SPAN_CACHE_MAX_FILES / 4 * 3)
+				break;
+			char* path = NULL;
+			if (SDL_asprintf(&path, "%s%s", dir, entries[i].name) < 0)
+				continue;
+			if (SDL_RemovePath(path))
+				total -= entries[i].size;
+			SDL_free(path);
+		}
+	}
+
+	free(entries);
+	SDL_free(names);
+}
+
+void spanCacheStore(const Surface* surf, uint64_t key)
+{
+	const size_t spansSize = surfaceSaveSpans2(surf, NULL, 0);
+	const size_t size = sizeof(SpanCacheHeader) + spansSize;
+	if (!spansSize || size > SPAN_CACHE_MAX_ENTRY)
+		return;
+	char* path = entryPath(key);
+	if (!path)
+		return;
+	uint8_t* data = malloc(size);
+	if (!data)
+	{
+		SDL_free(path);
+		return;
+	}
+
+	SpanCacheHeader head = { .version = SPAN_CACHE_VERSION, .w = surf->w, .h = surf->h, .key = key };
+	SDL_memcpy(head.magic, spanCacheMagic, sizeof(spanCacheMagic));
+	SDL_memcpy(data, &head, sizeof(SpanCacheHeader));
+	surfaceSaveSpans2(surf, data + sizeof(SpanCacheHeader), spansSize);
+
+	if (writeEntry(path, data, size))
+		trimCache(getCacheDir());
+
+	free(data);
+	SDL_free(path);
+}
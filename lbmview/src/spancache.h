@@ -0,0 +1,14 @@
+#ifndef SPANCACHE_H
+#define SPANCACHE_H
+
+#include "surface.h"
+
+// Key over the image pixels & range table, the cached spans are only valid for both
+uint64_t spanCacheKey(const Surface* surf,
+	const uint8_t hi[], const uint8_t low[],
+	const int16_t rate[], int numRanges);
+
+int spanCacheLoad(Surface* surf, uint64_t key);
+void spanCacheStore(const Surface* surf, uint64_t key);
+
+#endif//SPANCACHE_H
@@ -1,12 +1,28 @@
 /* surface.c - (C) 2023 a dinosaur (zlib) */
 #include "surface.h"
+#include "combine.h"
+#include "workpool.h"
+#include "scan.h"
 #include "util.h"
 #include "hsluv.h"
+#include "trace.h"
 #include <SDL3/SDL_render.h>
+#include <SDL3/SDL_timer.h>
+#include <SDL3/SDL_mutex.h>
 #include <stdlib.h>
 #include <stdbool.h>
 
 
+static void oklabInit(void);
+static void cacheSrcOklab(Surface* surf);
+
+void surfaceSetup(void)
+{
+	combineInit();
+	scanInit();
+	oklabInit();
+}
+
 int surfaceInit(Surface* surf,
 	int w, int h,
 	const uint8_t* pix, const Colour pal[])
@@ -14,19 +30,36 @@ int surfaceInit(Surface* surf,
 	if (!surf || !pix || !pal || !w || !h)
 		return -1;
 
+	surfaceSetup();
+
 	surf->srcPix = malloc(w * h);
 	if (!surf->srcPix)
 		return -1;
 
-	surf->comb = malloc(w * h * sizeof(Colour));
-	if (!surf->comb)
-		return -1;
-
 	SDL_memcpy(surf->srcPal, pal, sizeof(Colour) * LBM_PAL_SIZE);
 	SDL_memcpy(surf->pal, pal, sizeof(Colour) * LBM_PAL_SIZE);
+	SDL_memcpy(surf->combPal, pal, sizeof(Colour) * LBM_PAL_SIZE);
 	SDL_memcpy(surf->srcPix, pix, w * h);
 	surf->w = w;
 	surf->h = h;
+	surf->combFull = true;
+	cacheSrcOklab(surf);
+	return 0;
+}
+
+int surfaceAllocComb(Surface* surf)
+{
+	if (!surf || !surf->w || !surf->h)
+		return -1;
+	if (!surf->comb)
+	{
+		surf->comb = malloc(surf->w * (size_t)surf->h * sizeof(Colour));
+		if (!surf->comb)
+			return -1;
+	}
+	surf->dst = surf->comb;
+	surf->dstStride = (size_t)surf->w;
+	surf->dstX = surf->dstY = 0;
 	return 0;
 }
 
@@ -34,17 +67,34 @@ void surfaceFree(Surface* surf)
 {
 	if (!surf)
 		return;
+	if (surf->runs)
+	{
+		free(surf->runs);
+		surf->runs = NULL;
+	}
+	if (surf->tileRanges)
+	{
+		free(surf->tileRanges);
+		surf->tileRanges = NULL;
+	}
 	if (surf->spans)
 	{
 		free(surf->spans);
 		surf->spans = NULL;
 		surf->spanBufLen = 0;
 	}
+	if (surf->spanRows)
+	{
+		free(surf->spanRows);
+		surf->spanRows = NULL;
+		surf->spanRowBufLen = 0;
+	}
 	if (surf->comb)
 	{
 		free(surf->comb);
 		surf->comb = NULL;
 	}
+	surf->dst = NULL;
 	if (surf->srcPix)
 	{
 		free(surf->srcPix);
@@ -171,25 +221,34 @@ void surfaceRangeHsluv(Surface* surf, uint8_t hi, uint8_t low, int cycle, double
 	unsigned frame = (unsigned)rateTime;
 	tween = rateTime - (double)frame;
 
-	const Colour* src = surf->srcPal;
-	Colour* dst = surf->pal;
+	// Every colour in the range is both an old & a new one, so each is only converted once
+	float r[LBM_PAL_SIZE], g[LBM_PAL_SIZE], b[LBM_PAL_SIZE];
+	float h[LBM_PAL_SIZE], s[LBM_PAL_SIZE], l[LBM_PAL_SIZE];
+	const Colour* src = &surf->srcPal[low];
 	for (unsigned j = 0; j < range; ++j)
 	{
-		unsigned oldIdx = low + (j + frame) % range;
-		unsigned newIdx = low + (j + frame + 1) % range;
-		Colour old8 = src[oldIdx & 0xFF];
-		Colour new8 = src[newIdx & 0xFF];
+		r[j] = (float)COLOUR_R(src[j]) / 255.0f;
+		g[j] = (float)COLOUR_G(src[j]) / 255.0f;
+		b[j] = (float)COLOUR_B(src[j]) / 255.0f;
+	}
+	rgb2hsluv_batch(r, g, b, h, s, l, range);
 
-		double oldR = COLOUR_R(old8) / 255.0, oldG = COLOUR_G(old8) / 255.0, oldB = COLOUR_B(old8) / 255.0;
-		double newR = COLOUR_R(new8) / 255.0, newG = COLOUR_G(new8) / 255.0, newB = COLOUR_B(new8) / 255.0;
-		double oldH, oldS, oldL, newH, newS, newL;
-		rgb2hsluv(oldR, oldG, oldB, &oldH, &oldS, &oldL);
-		rgb2hsluv(newR, newG, newB, &newH, &newS, &newL);
-		double h = DEGLERP(oldH, newH, tween), s = LERP(oldS, newS, tween), v = LERP(oldL, newL, tween);
-		double r, g, b;
-		hsluv2rgb(h, s, v, &r, &g, &b);
-		uint8_t a = (uint8_t)LERP(COLOUR_A(old8), COLOUR_A(new8), tween);
-		dst[low + j] = MAKE_COLOUR((uint8_t)(r * 255.0), (uint8_t)(g * 255.0), (uint8_t)(b * 255.0), a);
+	float blendH[LBM_PAL_SIZE], blendS[LBM_PAL_SIZE], blendL[LBM_PAL_SIZE];
+	for (unsigned j = 0; j < range; ++j)
+	{
+		unsigned oldIdx = (j + frame) % range;
+		unsigned newIdx = (j + frame + 1) % range;
+		blendH[j] = (float)DEGLERP((double)h[oldIdx], (double)h[newIdx], tween);
+		blendS[j] = (float)LERP((double)s[oldIdx], (double)s[newIdx], tween);
+		blendL[j] = (float)LERP((double)l[oldIdx], (double)l[newIdx], tween);
+	}
+	hsluv2rgb_batch(blendH, blendS, blendL, r, g, b, range);
+
+	Colour* dst = &surf->pal[low];
+	for (unsigned j = 0; j < range; ++j)
+	{
+		uint8_t a = (uint8_t)LERP(COLOUR_A(src[(j + frame) % range]), COLOUR_A(src[(j + frame + 1) % range]), tween);
+		dst[j] = MAKE_COLOUR((uint8_t)(r[j] * 255.0f), (uint8_t)(g[j] * 255.0f), (uint8_t)(b[j] * 255.0f), a);
 	}
 }
 
@@ -257,241 +316,1269 @@ void surfaceRangeLab(Surface* surf, uint8_t hi, uint8_t low, int cycle, double t
 	}
 }
 
-static int resizeSpanBuffer(Surface* surf, int len)
+// Oklab blends run every frame, so they use tables & a cheap cube root in place of pow
+
+#define OKLAB_SRGB_LUT_BITS 12
+#define OKLAB_SRGB_LUT_SIZE (1 << OKLAB_SRGB_LUT_BITS)
+
+static float   linearFromSrgb8[256];
+static uint8_t srgb8FromLinear[OKLAB_SRGB_LUT_SIZE];
+
+static void oklabInit(void)
+{
+	static SDL_InitState init;
+	if (!SDL_ShouldInit(&init))
+		return;
+	for (unsigned i = 0; i < 256; ++i)
+		linearFromSrgb8[i] = (float)linearFromSrgb((double)i / 255.0);
+	for (unsigned i = 0; i < OKLAB_SRGB_LUT_SIZE; ++i)
+		srgb8FromLinear[i] = (uint8_t)(srgbFromLinear((double)i / (OKLAB_SRGB_LUT_SIZE - 1)) * 255.0 + 0.5);
+	SDL_SetInitialized(&init, true);
+}
+
+static inline uint8_t FORCE_INLINE srgb8FromLinearClamped(float x)
 {
-	if (!surf->spans)
+	// Out of gamut colours are simply clipped
+	return srgb8FromLinear[(int)(SATURATE(x) * (float)(OKLAB_SRGB_LUT_SIZE - 1) + 0.5f)];
+}
+
+static inline float FORCE_INLINE fastCbrtf(float x)
+{
+	// Bit hack initial guess, refined by two Newton iterations
+	uint32_t i;
+	SDL_memcpy(&i, &x, sizeof(float));
+	i = i / 3 + 0x2A514067;
+	float y;
+	SDL_memcpy(&y, &i, sizeof(float));
+	y = (2.0f / 3.0f) * y + x / (3.0f * y * y);
+	y = (2.0f / 3.0f) * y + x / (3.0f * y * y);
+	return y;
+}
+
+static void oklabFromColour(float lab[3], Colour c)
+{
+	const float r = linearFromSrgb8[COLOUR_R(c)], g = linearFromSrgb8[COLOUR_G(c)], b = linearFromSrgb8[COLOUR_B(c)];
+	const float l = fastCbrtf(0.4122214708f * r + 0.5363325363f * g + 0.0514459929f * b);
+	const float m = fastCbrtf(0.2119034982f * r + 0.6806995451f * g + 0.1073969566f * b);
+	const float s = fastCbrtf(0.0883024619f * r + 0.2817188376f * g + 0.6299787005f * b);
+	lab[0] = 0.2104542553f * l + 0.7936177850f * m - 0.0040720468f * s;
+	lab[1] = 1.9779984951f * l - 2.4285922050f * m + 0.4505937099f * s;
+	lab[2] = 0.0259040371f * l + 0.7827717662f * m - 0.8086757660f * s;
+}
+
+static Colour colourFromOklab(float lL, float lA, float lB, uint8_t alpha)
+{
+	float l = lL + 0.3963377774f * lA + 0.2158037573f * lB;
+	float m = lL - 0.1055613458f * lA - 0.0638541728f * lB;
+	float s = lL - 0.0894841775f * lA - 1.2914855480f * lB;
+	l = l * l * l, m = m * m * m, s = s * s * s;
+	return MAKE_COLOUR(
+		srgb8FromLinearClamped( 4.0767416621f * l - 3.3077115913f * m + 0.2309699292f * s),
+		srgb8FromLinearClamped(-1.2684380046f * l + 2.6097574011f * m - 0.3413193965f * s),
+		srgb8FromLinearClamped(-0.0041960863f * l - 0.7034186147f * m + 1.7076147010f * s),
+		alpha);
+}
+
+static void cacheSrcOklab(Surface* surf)
+{
+	oklabInit();
+	for (unsigned i = 0; i < LBM_PAL_SIZE; ++i)
 	{
-		surf->spans = malloc(sizeof(SurfSpan) * len);
-		surf->spanBufLen = len;
+		float* lab = surf->srcOklab[i];
+		oklabFromColour(lab, surf->srcPal[i]);
+		float* lch = surf->srcOklch[i];
+		lch[0] = lab[0];
+		lch[1] = sqrtf(lab[1] * lab[1] + lab[2] * lab[2]);
+		lch[2] = atan2f(lab[2], lab[1]) * (180.0f / SDL_PI_F);
 	}
-	else if (len > surf->spanBufLen)
+}
+
+void surfaceRangeOklab(Surface* surf, uint8_t hi, uint8_t low, int cycle, double tween)
+{
+	if (!surf || low >= hi)
+		return;
+
+	uint8_t range = ++hi - low;
+	double rateTime = efmod((double)cycle + tween, range);
+	unsigned frame = (unsigned)rateTime;
+	const float t = (float)(rateTime - (double)frame);
+
+	for (unsigned j = 0; j < range; ++j)
 	{
-		free(surf->spans);
-		surf->spans = malloc(sizeof(SurfSpan) * len);
-		surf->spanBufLen = len;
+		unsigned oldIdx = (low + (j + frame) % range) & 0xFF;
+		unsigned newIdx = (low + (j + frame + 1) % range) & 0xFF;
+		const float* from = surf->srcOklab[oldIdx];
+		const float* to = surf->srcOklab[newIdx];
+		uint8_t a = (uint8_t)LERP(COLOUR_A(surf->srcPal[oldIdx]), COLOUR_A(surf->srcPal[newIdx]), t);
+		surf->pal[low + j] = colourFromOklab(LERP(from[0], to[0], t), LERP(from[1], to[1], t), LERP(from[2], to[2], t), a);
 	}
-	if (!surf->spans)
+}
+
+// Below this chroma a colour's hue is noise, so the other colour's hue is used instead
+#define OKLCH_GREY_CHROMA 1e-4f
+
+void surfaceRangeOklch(Surface* surf, uint8_t hi, uint8_t low, int cycle, double tween)
+{
+	if (!surf || low >= hi)
+		return;
+
+	uint8_t range = ++hi - low;
+	double rateTime = efmod((double)cycle + tween, range);
+	unsigned frame = (unsigned)rateTime;
+	const float t = (float)(rateTime - (double)frame);
+
+	for (unsigned j = 0; j < range; ++j)
 	{
-		surf->spans = NULL;
-		surf->spanBufLen = 0;
-		return -1;
+		unsigned oldIdx = (low + (j + frame) % range) & 0xFF;
+		unsigned newIdx = (low + (j + frame + 1) % range) & 0xFF;
+		const float* from = surf->srcOklch[oldIdx];
+		const float* to = surf->srcOklch[newIdx];
+		float fromH = from[1] < OKLCH_GREY_CHROMA ? to[2] : from[2];
+		float toH = to[1] < OKLCH_GREY_CHROMA ? fromH : to[2];
+		float l = LERP(from[0], to[0], t), c = LERP(from[1], to[1], t);
+		float h = (float)DEGLERP((double)fromH, (double)toH, (double)t) * (SDL_PI_F / 180.0f);
+		uint8_t a = (uint8_t)LERP(COLOUR_A(surf->srcPal[oldIdx]), COLOUR_A(surf->srcPal[newIdx]), t);
+		surf->pal[low + j] = colourFromOklab(l, c * cosf(h), c * sinf(h), a);
 	}
-	return 0;
 }
 
-int surfaceComputeSpans(Surface* surf,
+static void buildCyclingSet(bool cycling[LBM_PAL_SIZE],
 	const uint8_t hi[], const uint8_t low[],
 	const int16_t rate[], int numRanges)
 {
-	if (!surf || !hi || !low || numRanges <= 0)
+	SDL_memset(cycling, 0, sizeof(bool) * LBM_PAL_SIZE);
+	for (int i = 0; i < numRanges; ++i)
+		if (rate[i] && hi[i] > low[i])
+			for (unsigned j = low[i]; j <= hi[i]; ++j)
+				cycling[j] = true;
+}
+
+static int reserveSpanRows(Surface* surf, int numRows)
+{
+	if (numRows + 1 <= surf->spanRowBufLen)
+		return 0;
+	free(surf->spanRows);
+	surf->spanRows = malloc(sizeof(uint32_t) * (size_t)(numRows + 1));
+	surf->spanRowBufLen = surf->spanRows ? numRows + 1 : 0;
+	return surf->spanRows ? 0 : -1;
+}
+
+static int reserveSpans(Surface* surf, size_t len)
+{
+	if (len <= (size_t)surf->spanBufLen)
+		return 0;
+	if (len > INT32_MAX)
 		return -1;
 
-	if (resizeSpanBuffer(surf, surf->h))
+	// Grow geometrically, keeping existing spans
+	size_t newLen = MAX(len, (size_t)surf->spanBufLen * 2);
+	newLen = MIN(newLen, (size_t)INT32_MAX);
+	SurfSpan* spans = realloc(surf->spans, sizeof(SurfSpan) * newLen);
+	if (!spans)
 		return -1;
+	surf->spans = spans;
+	surf->spanBufLen = (int)newLen;
+	return 0;
+}
 
-	surf->spanBeg = -1;
-	surf->spanEnd = 0;
+static void countSpanPixels(Surface* surf)
+{
+	surf->spanPixels = 0;
+	if (surf->spanBeg < 0)
+		return;
+	int numRows = MIN(surf->h, surf->spanEnd + 1) - surf->spanBeg;
+	for (uint32_t i = surf->spanRows[0]; i < surf->spanRows[numRows]; ++i)
+		surf->spanPixels += (size_t)(1 + surf->spans[i].r - surf->spans[i].l);
+}
 
-	const uint8_t* srcPix = surf->srcPix;
-	for (int j = 0; j < surf->h; ++j)
+// Estimated cost of an extra texture upload call in pixels, merging rects that waste less is a net win
+#define DIRTY_RECT_OVERHEAD 0x1000
+
+typedef struct { int l, r, beg, end; } DirtyBand;
+
+static size_t bandArea(DirtyBand b)
+{
+	return (size_t)(1 + b.r - b.l) * (size_t)(b.end - b.beg);
+}
+
+static DirtyBand bandUnion(DirtyBand a, DirtyBand b)
+{
+	return (DirtyBand){ MIN(a.l, b.l), MAX(a.r, b.r), a.beg, b.end };
+}
+
+static SurfRect bandRect(DirtyBand b)
+{
+	return (SurfRect){ b.l, b.beg, 1 + b.r - b.l, b.end - b.beg };
+}
+
+static void computeDirtyRects(Surface* surf)
+{
+	surf->numDirty = 0;
+	surf->dirtyBounds = (SurfRect){ 0, 0, 0, 0 };
+	if (surf->spanBeg < 0)
+		return;
+	int numRows = MIN(surf->h, surf->spanEnd + 1) - surf->spanBeg;
+	if (numRows <= 0)
+		return;
+
+	DirtyBand* bands = malloc(sizeof(DirtyBand) * (size_t)numRows);
+	int numBands = 0;
+	DirtyBand bounds = { surf->w, -1, surf->h, 0 };
+	for (int i = 0; i < numRows; ++i)
 	{
-		SurfSpan cur = { 0, (int16_t)(surf->w - 1), -1, -1 };
+		if (surf->spanRows[i] == surf->spanRows[i + 1])
+			continue;
+		const int y = surf->spanBeg + i;
+		int l = surf->w, r = -1;
+		for (uint32_t k = surf->spanRows[i]; k < surf->spanRows[i + 1]; ++k)
+		{
+			l = MIN(l, surf->spans[k].l);
+			r = MAX(r, surf->spans[k].r);
+		}
+		bounds = (DirtyBand){ MIN(bounds.l, l), MAX(bounds.r, r), MIN(bounds.beg, y), y + 1 };
+
+		if (!bands)
+			continue;
+		DirtyBand* last = numBands ? &bands[numBands - 1] : NULL;
+		if (last && last->end == y && last->l == l && last->r == r)
+			++last->end;
+		else
+			bands[numBands++] = (DirtyBand){ l, r, y, y + 1 };
+	}
+	if (bounds.r < bounds.l)
+	{
+		free(bands);
+		return;
+	}
+	surf->dirtyBounds = bandRect(bounds);
 
-		// Find outer bounds
-		bool searchL = true, searchR = true;
-		do
+	uint8_t* covered = bands ? malloc((size_t)surf->w) : NULL;
+	if (!covered)
+	{
+		free(bands);
+		surf->dirty[surf->numDirty++] = surf->dirtyBounds;
+		return;
+	}
+
+	// Greedily merge the vertically neighbouring pair that wastes the least area
+	while (numBands > 1)
+	{
+		int best = 0;
+		size_t bestWaste = SIZE_MAX;
+		for (int i = 0; i < numBands - 1; ++i)
 		{
-			if (searchL)
-			{
-				uint8_t p = srcPix[cur.l];
-				for (int i = 0; i < numRanges; ++i)
-					if (rate[i] && hi[i] > low[i] && p >= low[i] && p <= hi[i])
-					{
-						searchL = false;
-						break;
-					}
-
-				if (searchL)
-				{
-					++cur.l;
-					if (cur.l >= cur.r)
-						searchL = false;
-				}
-			}
-			if (searchR)
+			size_t waste = bandArea(bandUnion(bands[i], bands[i + 1]))
+				- bandArea(bands[i]) - bandArea(bands[i + 1]);
+			if (waste < bestWaste)
 			{
-				uint8_t p = srcPix[cur.r];
-				for (int i = 0; i < numRanges; ++i)
-					if (rate[i] && hi[i] > low[i] && p >= low[i] && p <= hi[i])
-					{
-						searchR = false;
-						break;
-					}
-
-				if (searchR)
-				{
-					--cur.r;
-					if (cur.r <= cur.l)
-						searchR = false;
-				}
+				best = i;
+				bestWaste = waste;
 			}
 		}
-		while (searchL || searchR);
+		if (numBands <= SURFACE_MAX_DIRTY && bestWaste > DIRTY_RECT_OVERHEAD)
+			break;
 
-		if (cur.r - cur.l >= 0)
+		bands[best] = bandUnion(bands[best], bands[best + 1]);
+		SDL_memmove(&bands[best + 1], &bands[best + 2], sizeof(DirtyBand) * (size_t)(numBands - best - 2));
+		--numBands;
+	}
+
+	for (int i = 0; i < numBands; ++i)
+	{
+		// Find the widest column range that no span in the band touches
+		DirtyBand band = bands[i];
+		SDL_memset(&covered[band.l], 0, (size_t)(1 + band.r - band.l));
+		for (int y = band.beg; y < band.end; ++y)
 		{
-			// Find inner hole
-			if (cur.r - cur.l > 1)
-			{
-				int tmpL = cur.l + 1;
-				bool inHole = false;
-				for (int i = tmpL; i <= cur.r; ++i)
-				{
-					bool cycling = false;
-					uint8_t p = srcPix[i];
-					for (int k = 0; k < numRanges; ++k)
-						if (rate[k] && hi[k] > low[k] && p >= low[k] && p <= hi[k])
-						{
-							cycling = true;
-							break;
-						}
-					if (cycling)
-					{
-						int inner = (i - 1) - tmpL;
-						if (inner > cur.inR - cur.inL)
-							cur.inR = (cur.inL = (int16_t)tmpL) + (int16_t)inner;
-						tmpL = i;
-						inHole = false;
-					}
-					else if (!inHole)
-					{
-						tmpL = i;
-						inHole = true;
-					}
-				}
-			}
+			const int row = y - surf->spanBeg;
+			for (uint32_t k = surf->spanRows[row]; k < surf->spanRows[row + 1]; ++k)
+				SDL_memset(&covered[surf->spans[k].l], 1, (size_t)(1 + surf->spans[k].r - surf->spans[k].l));
+		}
+		int gapL = 0, gapR = -1;
+		for (int x = band.l + 1, beg = x; x < band.r; ++x)
+		{
+			if (covered[x])
+				beg = x + 1;
+			else if (x - beg > gapR - gapL)
+				gapL = beg, gapR = x;
+		}
 
-			if (surf->spanBeg < 0)
+		// Split into left & right halves if it saves enough
+		const size_t saved = (size_t)(1 + gapR - gapL) * (size_t)(band.end - band.beg);
+		if (gapL <= gapR && saved > DIRTY_RECT_OVERHEAD
+			&& numBands - i + surf->numDirty < SURFACE_MAX_DIRTY)
+		{
+			surf->dirty[surf->numDirty++] = bandRect((DirtyBand){ band.l, gapL - 1, band.beg, band.end });
+			surf->dirty[surf->numDirty++] = bandRect((DirtyBand){ gapR + 1, band.r, band.beg, band.end });
+		}
+		else
+		{
+			surf->dirty[surf->numDirty++] = bandRect(band);
+		}
+	}
+	free(covered);
+	free(bands);
+}
+
+static void finishSpans(Surface* surf)
+{
+	countSpanPixels(surf);
+	computeDirtyRects(surf);
+}
+
+// Static gaps up to this many pixels are cheaper to recombine than to start a new span over
+#define SPAN_MERGE_GAP 8
+
+// Smallest image area worth splitting the scan over other threads
+#define SPAN_BAND_PIXELS 0x20000
+
+typedef struct { SurfSpan* spans; size_t numSpans, bufLen; bool failed; } SpanBand;
+
+typedef struct
+{
+	const Surface* surf;
+	const ScanSet* set;
+	uint32_t* rowCounts;
+	SpanBand* bands;
+	int numBands;
+} SpanScan;
+
+static bool appendSpan(SpanBand* band, SurfSpan span)
+{
+	if (band->numSpans == band->bufLen)
+	{
+		size_t newLen = MAX(64U, band->bufLen * 2);
+		SurfSpan* spans = realloc(band->spans, sizeof(SurfSpan) * newLen);
+		if (!spans)
+			return false;
+		band->spans = spans;
+		band->bufLen = newLen;
+	}
+	band->spans[band->numSpans++] = span;
+	return true;
+}
+
+// Position of the next set bit (or clear bit if invert is all ones) at or after from
+static int findBit(const uint64_t* bits, int from, int len, uint64_t invert)
+{
+	for (int k = from >> 6; k * 64 < len; ++k)
+	{
+		uint64_t word = bits[k] ^ invert;
+		if (k == from >> 6)
+			word &= ~UINT64_C(0) << (from & 63);
+		if (word)
+			return MIN(len, k * 64 + ctz64(word));
+	}
+	return len;
+}
+
+static void scanSpanBandJob(void* user, int index)
+{
+	const SpanScan* scan = user;
+	const Surface* surf = scan->surf;
+	SpanBand* band = &scan->bands[index];
+	const int beg = (int)((long)surf->h * index / scan->numBands);
+	const int end = (int)((long)surf->h * (index + 1) / scan->numBands);
+
+	uint64_t* bits = malloc(sizeof(uint64_t) * (((size_t)surf->w + 63) / 64));
+	if (!bits)
+	{
+		band->failed = true;
+		return;
+	}
+
+	for (int j = beg; j < end; ++j)
+	{
+		scanClassifyRow(bits, &surf->srcPix[(size_t)j * surf->w], scan->set, (size_t)surf->w);
+
+		// Walk runs of cycling pixels, merging any separated by small gaps
+		const size_t rowBeg = band->numSpans;
+		for (int i = findBit(bits, 0, surf->w, 0); i < surf->w;)
+		{
+			const int r = findBit(bits, i, surf->w, UINT64_MAX) - 1;
+			if (band->numSpans > rowBeg && i - band->spans[band->numSpans - 1].r <= SPAN_MERGE_GAP + 1)
 			{
-				surf->spanBeg = j;
+				band->spans[band->numSpans - 1].r = (int16_t)r;
 			}
-			else
+			else if (!appendSpan(band, (SurfSpan){ (int16_t)i, (int16_t)r }))
 			{
-				// Fill gaps
-				for (int i = surf->spanEnd + 1; i < j; ++i)
-					surf->spans[i - surf->spanBeg] = (SurfSpan){ -1, -1, -1, -1 };
+				band->failed = true;
+				break;
 			}
-			surf->spans[j - surf->spanBeg] = cur;
-			surf->spanEnd = j;
+			i = findBit(bits, r + 1, surf->w, 0);
 		}
-		srcPix += surf->w;
+		scan->rowCounts[j] = (uint32_t)(band->numSpans - rowBeg);
+	}
+	free(bits);
+}
+
+static int computeSpans(Surface* surf,
+	const uint8_t hi[], const uint8_t low[],
+	const int16_t rate[], int numRanges,
+	WorkPool* pool)
+{
+	if (!surf || !hi || !low || numRanges <= 0)
+		return -1;
+
+	if (reserveSpanRows(surf, surf->h))
+		return -1;
+
+	bool cycling[LBM_PAL_SIZE];
+	buildCyclingSet(cycling, hi, low, rate, numRanges);
+	ScanSet set;
+	scanBuildSet(&set, cycling);
+
+	// Large images are scanned in row bands across the pool, each into its own buffer
+	size_t maxBands = MAX(1U, surf->w * (size_t)surf->h / SPAN_BAND_PIXELS);
+	int numBands = (int)MIN(maxBands, (size_t)workPoolNumThreads(pool) * 4);
+	numBands = MIN(numBands, surf->h);
+	SpanBand* bands = calloc((size_t)numBands, sizeof(SpanBand));
+	if (!bands)
+		return -1;
+
+	// Spans per row are counted into the row table, then summed into offsets below
+	SpanScan scan = { surf, &set, &surf->spanRows[1], bands, numBands };
+	if (numBands > 1)
+		workPoolRun(pool, scanSpanBandJob, &scan, numBands);
+	else
+		scanSpanBandJob(&scan, 0);
+
+	size_t numSpans = 0;
+	bool failed = false;
+	for (int i = 0; i < numBands; ++i)
+	{
+		numSpans += bands[i].numSpans;
+		failed |= bands[i].failed;
+	}
+	failed = failed || numSpans > UINT32_MAX || reserveSpans(surf, MAX(1U, numSpans));
+	size_t ofs = 0;
+	for (int i = 0; i < numBands; ++i)
+	{
+		if (!failed && bands[i].numSpans)
+			SDL_memcpy(&surf->spans[ofs], bands[i].spans, sizeof(SurfSpan) * bands[i].numSpans);
+		ofs += bands[i].numSpans;
+		free(bands[i].spans);
+	}
+	free(bands);
+	if (failed)
+	{
+		// Fall back to full combines rather than leave partial spans behind
+		free(surf->spans);
+		surf->spans = NULL;
+		surf->spanBufLen = 0;
+		return -1;
 	}
 
+	surf->spanBeg = -1;
+	surf->spanEnd = 0;
+	for (int j = 0; j < surf->h; ++j)
+	{
+		if (!scan.rowCounts[j])
+			continue;
+		if (surf->spanBeg < 0)
+			surf->spanBeg = j;
+		surf->spanEnd = j;
+	}
+	if (surf->spanBeg >= 0)
+	{
+		// Rows before the first span are empty, so the offsets can be summed down in place
+		uint32_t sum = 0;
+		surf->spanRows[0] = 0;
+		for (int j = surf->spanBeg; j <= surf->spanEnd; ++j)
+			surf->spanRows[j - surf->spanBeg + 1] = (sum += scan.rowCounts[j]);
+	}
+
+	finishSpans(surf);
 	return 0;
 }
 
+int surfaceComputeSpans(Surface* surf,
+	const uint8_t hi[], const uint8_t low[],
+	const int16_t rate[], int numRanges,
+	WorkPool* pool)
+{
+	TRACE_BEGIN(zone);
+	const int res = computeSpans(surf, hi, low, rate, numRanges, pool);
+	TRACE_END(zone, "surfaceComputeSpans");
+	return res;
+}
+
+// Append a span read from a precomputed chunk, dropping any that fall outside the image
+static void loadSpan(Surface* surf, uint32_t* numSpans, int l, int r)
+{
+	l = MAX(0, l);
+	r = MIN(surf->w - 1, r);
+	if (l <= r)
+		surf->spans[(*numSpans)++] = (SurfSpan){ (int16_t)l, (int16_t)r };
+}
+
+static int beginLoadSpans(Surface* surf, int startOfs, int numRows, size_t maxSpans)
+{
+	if (startOfs < 0 || startOfs >= surf->h || numRows < 1)
+		return -1;
+	numRows = MIN(numRows, surf->h - startOfs);
+	if (reserveSpanRows(surf, numRows) || reserveSpans(surf, MAX(1U, maxSpans)))
+		return -1;
+
+	surf->spanBeg = startOfs;
+	surf->spanEnd = startOfs + numRows - 1;
+	SDL_memset(surf->spanRows, 0, sizeof(uint32_t) * (size_t)(numRows + 1));
+	return numRows;
+}
+
 int surfaceLoadSpans(Surface* surf, const void* chunk, size_t size)
 {
 	if (!surf || !chunk || size < sizeof(int16_t) * 3)
 		return -1;
 
 	const int16_t* read = (const int16_t*)chunk;
+	const int16_t* end = read + (size / sizeof(int16_t));
 	int startOfs = SWAP_BE16(*read++);
 	int spanLen  = SWAP_BE16(*read++);
-	if (startOfs < 0 || spanLen < 1)
+
+	// Every row holds at most two spans either side of its hole
+	int numRows = beginLoadSpans(surf, startOfs, spanLen, (size_t)spanLen * 2);
+	if (numRows < 0)
 		return -1;
 
-	if (resizeSpanBuffer(surf, spanLen))
+	uint32_t numSpans = 0;
+	for (int i = 0; i < numRows && read < end; ++i)
+	{
+		int16_t l = SWAP_BE16(*read++), r = -1, inL = -1, inR = -1;
+		if (l >= 0 && read < end)
+		{
+			r = SWAP_BE16(*read++);
+			if (read < end)
+				inL = SWAP_BE16(*read++);
+			if (inL >= 0 && read < end)
+				inR = SWAP_BE16(*read++);
+		}
+
+		if (l >= 0 && inL < 0)
+		{
+			loadSpan(surf, &numSpans, l, r);
+		}
+		else if (l >= 0)
+		{
+			loadSpan(surf, &numSpans, l, inL - 1);
+			loadSpan(surf, &numSpans, inR + 1, r);
+		}
+		surf->spanRows[i + 1] = numSpans;
+	}
+	for (int i = 0; i < numRows; ++i)
+		surf->spanRows[i + 1] = MAX(surf->spanRows[i], surf->spanRows[i + 1]);
+
+	finishSpans(surf);
+	return 0;
+}
+
+int surfaceLoadSpans2(Surface* surf, const void* chunk, size_t size)
+{
+	if (!surf || !chunk || size < sizeof(int16_t) * 3)
 		return -1;
 
-	const int16_t* end = (const int16_t*)chunk + (size / sizeof(int16_t));
-	for (size_t i = 0; i < (size_t)spanLen; ++i)
+	const int16_t* read = (const int16_t*)chunk;
+	const int16_t* end = read + (size / sizeof(int16_t));
+	int startOfs = SWAP_BE16(*read++);
+	int spanLen  = SWAP_BE16(*read++);
+
+	// Each span takes two words, so the chunk size bounds the total
+	int numRows = beginLoadSpans(surf, startOfs, spanLen, (size_t)(end - read) / 2);
+	if (numRows < 0)
+		return -1;
+
+	uint32_t numSpans = 0;
+	for (int i = 0; i < numRows && read < end; ++i)
 	{
-		SurfSpan* span = &surf->spans[i];
-		*span = (SurfSpan){ -1, -1, -1, -1 };
+		int rowSpans = (uint16_t)SWAP_BE16(*read++);
+		for (int k = 0; k < rowSpans && end - read >= 2; ++k, read += 2)
+			loadSpan(surf, &numSpans, SWAP_BE16(read[0]), SWAP_BE16(read[1]));
+		surf->spanRows[i + 1] = numSpans;
+	}
+	for (int i = 0; i < numRows; ++i)
+		surf->spanRows[i + 1] = MAX(surf->spanRows[i], surf->spanRows[i + 1]);
 
-		span->l = SWAP_BE16(*read++);
-		if (read == end)
-			break;
-		if (span->l < 0)
+	finishSpans(surf);
+	return 0;
+}
+
+size_t surfaceSaveSpans2(const Surface* surf, void* chunk, size_t size)
+{
+	if (!surf || !surf->spans)
+		return 0;
+
+	// Images without any cycling pixels are stored as a single empty row
+	const bool empty = surf->spanBeg < 0;
+	const int numRows = empty ? 1 : surf->spanEnd - surf->spanBeg + 1;
+	const size_t numSpans = empty ? 0 : surf->spanRows[numRows];
+	if (numRows > INT16_MAX || surf->spanBeg > INT16_MAX)
+		return 0;
+	const size_t need = sizeof(int16_t) * (2 + (size_t)numRows + numSpans * 2);
+	if (!chunk || size < need)
+		return need;
+
+	int16_t* write = (int16_t*)chunk;
+	*write++ = (int16_t)SWAP_BE16((uint16_t)(empty ? 0 : surf->spanBeg));
+	*write++ = (int16_t)SWAP_BE16((uint16_t)numRows);
+	for (int i = 0; i < numRows; ++i)
+	{
+		const uint32_t beg = empty ? 0 : surf->spanRows[i], end = empty ? 0 : surf->spanRows[i + 1];
+		if (end - beg > UINT16_MAX)
+			return 0;
+		*write++ = (int16_t)SWAP_BE16((uint16_t)(end - beg));
+		for (uint32_t k = beg; k < end; ++k)
+		{
+			*write++ = (int16_t)SWAP_BE16((uint16_t)surf->spans[k].l);
+			*write++ = (int16_t)SWAP_BE16((uint16_t)surf->spans[k].r);
+		}
+	}
+	return need;
+}
+
+// Is source pixel x, y covered by one of its row's spans
+static bool inSpans(const Surface* surf, int x, int y)
+{
+	if (y < surf->spanBeg || y > MIN(surf->h - 1, surf->spanEnd))
+		return false;
+	const int row = y - surf->spanBeg;
+	for (uint32_t i = surf->spanRows[row]; i < surf->spanRows[row + 1] && surf->spans[i].l <= x; ++i)
+		if (x <= surf->spans[i].r)
+			return true;
+	return false;
+}
+
+// Most common index in the block, ties go to whichever reached the count first,
+//  counts are left zeroed again for the next block
+static uint8_t majorityIndex(const Surface* src, uint32_t* counts, int x0, int x1, int y0, int y1, int* sx, int* sy)
+{
+	uint8_t best = src->srcPix[(size_t)y0 * src->w + x0];
+	*sx = x0;
+	*sy = y0;
+	for (int y = y0; y < y1; ++y)
+	{
+		const uint8_t* row = &src->srcPix[(size_t)y * src->w];
+		for (int x = x0; x < x1; ++x)
+			if (++counts[row[x]] > counts[best])
+				best = row[x];
+	}
+	bool found = false;
+	for (int y = y0; y < y1; ++y)
+	{
+		const uint8_t* row = &src->srcPix[(size_t)y * src->w];
+		for (int x = x0; x < x1; ++x)
+		{
+			if (!found && row[x] == best)
+			{
+				*sx = x;
+				*sy = y;
+				found = true;
+			}
+			counts[row[x]] = 0;
+		}
+	}
+	return best;
+}
+
+int surfaceInitScaled(Surface* surf, const Surface* src, int w, int h, SurfaceScaleMode mode)
+{
+	if (!surf || !src || !src->srcPix || w <= 0 || h <= 0 || w > src->w || h > src->h)
+		return -1;
+
+	surf->srcPix = malloc(w * (size_t)h);
+	// Where each pixel of the row was taken from, so it cycles exactly when its source pixel does
+	int* from = malloc(sizeof(int) * 2 * (size_t)w);
+	const bool withSpans = src->spans != NULL;
+	if (!surf->srcPix || !from || (withSpans && reserveSpanRows(surf, h)))
+	{
+		free(from);
+		surfaceFree(surf);
+		return -1;
+	}
+
+	SDL_memcpy(surf->srcPal, src->srcPal, sizeof(Colour) * LBM_PAL_SIZE);
+	SDL_memcpy(surf->pal, src->pal, sizeof(Colour) * LBM_PAL_SIZE);
+	SDL_memcpy(surf->combPal, src->combPal, sizeof(Colour) * LBM_PAL_SIZE);
+	SDL_memcpy(surf->srcOklab, src->srcOklab, sizeof(src->srcOklab));
+	SDL_memcpy(surf->srcOklch, src->srcOklch, sizeof(src->srcOklch));
+	surf->w = w;
+	surf->h = h;
+	surf->combFull = true;
+
+	uint32_t counts[LBM_PAL_SIZE] = { 0 };
+	uint32_t numSpans = 0;
+	surf->spanBeg = -1;
+	surf->spanEnd = 0;
+	for (int j = 0; j < h; ++j)
+	{
+		// Blocks are the source pixels from this edge up to the next, nearest samples their centres
+		const int y0 = (int)((int64_t)j * src->h / h), y1 = (int)((int64_t)(j + 1) * src->h / h);
+		const int cy = (int)(((int64_t)j * 2 + 1) * src->h / ((int64_t)h * 2));
+		uint8_t* dstRow = &surf->srcPix[(size_t)j * w];
+		for (int i = 0; i < w; ++i)
+		{
+			int* sx = &from[i * 2], * sy = &from[i * 2 + 1];
+			if (mode == SURFACE_SCALE_MAJORITY)
+			{
+				const int x0 = (int)((int64_t)i * src->w / w), x1 = (int)((int64_t)(i + 1) * src->w / w);
+				dstRow[i] = majorityIndex(src, counts, x0, x1, y0, y1, sx, sy);
+			}
+			else
+			{
+				*sx = (int)(((int64_t)i * 2 + 1) * src->w / ((int64_t)w * 2));
+				*sy = cy;
+				dstRow[i] = src->srcPix[(size_t)*sy * src->w + *sx];
+			}
+		}
+
+		if (!withSpans)
 			continue;
-		span->r = SWAP_BE16(*read++);
-		if (read == end)
-			break;
-		span->inL = SWAP_BE16(*read++);
-		if (read == end)
-			break;
-		if (span->inL < 0)
+		// Row offsets are kept by absolute row until the first & last are known
+		surf->spanRows[j] = numSpans;
+		if (src->spanBeg < 0)
 			continue;
-		span->inR = SWAP_BE16(*read++);
-		if (read == end)
-			break;
+		for (int i = 0; i < w;)
+		{
+			if (!inSpans(src, from[i * 2], from[i * 2 + 1]))
+			{
+				++i;
+				continue;
+			}
+			const int l = i;
+			while (i < w && inSpans(src, from[i * 2], from[i * 2 + 1]))
+				++i;
+			if (reserveSpans(surf, (size_t)numSpans + 1))
+			{
+				free(from);
+				surfaceFree(surf);
+				return -1;
+			}
+			surf->spans[numSpans++] = (SurfSpan){ (int16_t)l, (int16_t)(i - 1) };
+			if (surf->spanBeg < 0)
+				surf->spanBeg = j;
+			surf->spanEnd = j;
+		}
 	}
+	free(from);
+	if (!withSpans)
+		return 0;
+
+	surf->spanRows[h] = numSpans;
+	if (surf->spanBeg >= 0)
+		SDL_memmove(surf->spanRows, &surf->spanRows[surf->spanBeg],
+			sizeof(uint32_t) * (size_t)(surf->spanEnd - surf->spanBeg + 2));
+	finishSpans(surf);
+	return 0;
+}
 
-	surf->spanBeg = startOfs;
-	surf->spanEnd = startOfs + spanLen - 1;
+// Rough per-run cost in pixels for the loop & fill setup, used to decide if runs beat spans
+#define RUN_OVERHEAD 4
+
+int surfaceComputeRuns(Surface* surf,
+	const uint8_t hi[], const uint8_t low[],
+	const int16_t rate[], int numRanges)
+{
+	if (!surf || !hi || !low || numRanges <= 0)
+		return -1;
+
+	if (surf->runs)
+	{
+		free(surf->runs);
+		surf->runs = NULL;
+	}
+
+	bool cycling[LBM_PAL_SIZE];
+	buildCyclingSet(cycling, hi, low, rate, numRanges);
+
+	// Count runs per palette index
+	uint32_t numRuns[LBM_PAL_SIZE] = { 0 };
+	size_t numPixels = 0, totalRuns = 0;
+	const uint8_t* srcPix = surf->srcPix;
+	for (int j = 0; j < surf->h; ++j)
+	{
+		for (int i = 0; i < surf->w;)
+		{
+			uint8_t p = srcPix[i];
+			int runBeg = i;
+			while (++i < surf->w && srcPix[i] == p);
+			if (!cycling[p])
+				continue;
+			++numRuns[p];
+			++totalRuns;
+			numPixels += (size_t)(i - runBeg);
+		}
+		srcPix += surf->w;
+	}
+
+	// Only worth using over the span buffer if it touches fewer pixels per frame
+	size_t spanPixels = surf->spans ? surf->spanPixels : surf->w * (size_t)surf->h;
+	if (!totalRuns || numPixels + totalRuns * RUN_OVERHEAD >= spanPixels)
+		return 0;
+
+	surf->runs = malloc(sizeof(SurfRun) * totalRuns);
+	if (!surf->runs)
+		return -1;
+
+	surf->runOfs[0] = 0;
+	for (unsigned i = 0; i < LBM_PAL_SIZE; ++i)
+		surf->runOfs[i + 1] = surf->runOfs[i] + numRuns[i];
+
+	// Fill runs, rows are visited in order so each index's runs are sorted top to bottom
+	uint32_t fill[LBM_PAL_SIZE];
+	SDL_memcpy(fill, surf->runOfs, sizeof(fill));
+	srcPix = surf->srcPix;
+	for (int j = 0; j < surf->h; ++j)
+	{
+		for (int i = 0; i < surf->w;)
+		{
+			uint8_t p = srcPix[i];
+			int runBeg = i;
+			while (++i < surf->w && srcPix[i] == p);
+			if (cycling[p])
+				surf->runs[fill[p]++] = (SurfRun){ (uint16_t)runBeg, (uint16_t)j, (uint16_t)(i - runBeg) };
+		}
+		srcPix += surf->w;
+	}
+
+	return 0;
+}
+
+
+#define TILE_SIZE 32
+
+int surfaceComputeTiles(Surface* surf,
+	const uint8_t hi[], const uint8_t low[],
+	const int16_t rate[], int numRanges)
+{
+	if (!surf || !hi || !low || numRanges <= 0 || numRanges > 16)
+		return -1;
+
+	if (surf->tileRanges)
+	{
+		free(surf->tileRanges);
+		surf->tileRanges = NULL;
+	}
+
+	uint16_t rangeMask[LBM_PAL_SIZE] = { 0 };
+	for (int i = 0; i < numRanges; ++i)
+		if (rate[i] && hi[i] > low[i])
+			for (unsigned j = low[i]; j <= hi[i]; ++j)
+				rangeMask[j] |= (uint16_t)(1U << i);
+
+	surf->tilesW = (surf->w + TILE_SIZE - 1) / TILE_SIZE;
+	surf->tilesH = (surf->h + TILE_SIZE - 1) / TILE_SIZE;
+	surf->tileRanges = calloc((size_t)surf->tilesW * (size_t)surf->tilesH, sizeof(uint16_t));
+	if (!surf->tileRanges)
+		return -1;
+
+	const uint8_t* srcPix = surf->srcPix;
+	for (int j = 0; j < surf->h; ++j, srcPix += surf->w)
+	{
+		uint16_t* tiles = &surf->tileRanges[(j / TILE_SIZE) * surf->tilesW];
+		for (int i = 0; i < surf->w; ++i)
+			tiles[i / TILE_SIZE] |= rangeMask[srcPix[i]];
+	}
 	return 0;
 }
 
+static inline Colour* dstPixel(const Surface* surf, int x, int y)
+{
+	return surf->dst + (size_t)(y - surf->dstY) * surf->dstStride + (x - surf->dstX);
+}
 
 void surfaceCombine(Surface* surf)
 {
-	if (!surf)
+	if (!surf || !surf->dst)
 		return;
 
-	const uint8_t* srcPix = surf->srcPix;
-	Colour* dst = surf->comb;
-	size_t dstLen = surf->w * (size_t)surf->h;
+	surf->stats.pixels += surf->w * (size_t)surf->h;
+	if (surf->dstStride == (size_t)surf->w)
+	{
+		combineRow(surf->dst, surf->srcPix, surf->pal, surf->w * (size_t)surf->h);
+	}
+	else
+	{
+		const uint8_t* srcPix = surf->srcPix;
+		for (int j = 0; j < surf->h; ++j, srcPix += surf->w)
+			combineRow(dstPixel(surf, 0, j), srcPix, surf->pal, (size_t)surf->w);
+	}
+	SDL_memcpy(surf->combPal, surf->pal, sizeof(Colour) * LBM_PAL_SIZE);
+}
+
+static void combineSpanRows(Surface* surf, int beg, int end)
+{
+	for (int i = beg; i < end; ++i)
+	{
+		const int y = surf->spanBeg + i;
+		const uint8_t* srcPix = surf->srcPix + (size_t)y * surf->w;
+		for (uint32_t k = surf->spanRows[i]; k < surf->spanRows[i + 1]; ++k)
+		{
+			const SurfSpan span = surf->spans[k];
+			combineRow(dstPixel(surf, span.l, y), &srcPix[span.l], surf->pal, (size_t)(1 + span.r - span.l));
+		}
+	}
+}
+
+// Smallest band worth handing to another thread (256 KiB of output)
+#define COMBINE_BAND_PIXELS 0x10000
+
+typedef struct { Surface* surf; int numSpans, numBands; } CombineBands;
+
+static void combineBandJob(void* user, int index)
+{
+	const CombineBands* bands = user;
+	int beg = (int)((long)bands->numSpans * index / bands->numBands);
+	int end = (int)((long)bands->numSpans * (index + 1) / bands->numBands);
+	combineSpanRows(bands->surf, beg, end);
+}
+
+void surfaceCombinePartial(Surface* surf, WorkPool* pool)
+{
+	if (!surf || !surf->dst || !surf->spans || surf->spanBeg < 0)
+		return;
+
+	int numSpans = MIN(surf->h, surf->spanEnd + 1) - surf->spanBeg;
+	surf->stats.pixels += surf->spanPixels;
 
-	for (size_t i = 0; i < dstLen; ++i)
+	// Small images stay on the calling thread, large ones get split into contiguous row bands
+	size_t maxBands = MAX(1U, surf->spanPixels / COMBINE_BAND_PIXELS);
+	int numBands = (int)MIN(maxBands, (size_t)workPoolNumThreads(pool));
+	numBands = MIN(numBands, numSpans);
+	if (numBands > 1)
 	{
-		uint8_t c = (*srcPix++);
-		(*dst++) = surf->pal[c];
+		CombineBands bands = { surf, numSpans, numBands };
+		workPoolRun(pool, combineBandJob, &bands, numBands);
 	}
+	else
+	{
+		combineSpanRows(surf, 0, numSpans);
+	}
+
+	// Spans cover every cycling pixel, so the whole palette is now reflected
+	SDL_memcpy(surf->combPal, surf->pal, sizeof(Colour) * LBM_PAL_SIZE);
 }
 
-void surfaceCombinePartial(Surface* surf)
+void surfaceCombineRuns(Surface* surf)
 {
-	if (!surf || !surf->spans || surf->spanBeg < 0)
+	if (!surf || !surf->dst || !surf->runs)
 		return;
 
-	const uint8_t* srcPix = surf->srcPix + surf->spanBeg * surf->w;
-	Colour* dst = surf->comb + surf->spanBeg * surf->w;
+	for (unsigned i = 0; i < LBM_PAL_SIZE; ++i)
+	{
+		// Only refill indices that have changed colour since the last combine
+		const Colour c = surf->pal[i];
+		if (c == surf->combPal[i])
+			continue;
+		surf->combPal[i] = c;
 
-	int numSpans = MIN(surf->h, surf->spanEnd + 1) - surf->spanBeg;
-	for (int i = 0; i < numSpans; ++i)
+		const SurfRun* run = &surf->runs[surf->runOfs[i]];
+		const SurfRun* end = &surf->runs[surf->runOfs[i + 1]];
+		for (; run < end; ++run)
+		{
+			SDL_memset4(dstPixel(surf, run->x, run->y), c, run->len);
+			surf->stats.pixels += run->len;
+		}
+	}
+}
+
+static void combineScaledRow(Surface* surf, const int* cols, const int* rows, int y, int l, int r)
+{
+	const int y0 = rows[y], y1 = rows[y + 1];
+	if (y0 == y1)
+		return;
+	const uint8_t* srcPix = surf->srcPix + (size_t)y * surf->w;
+	Colour* dst = dstPixel(surf, 0, y0);
+	for (int x = l; x <= r; ++x)
+		SDL_memset4(&dst[cols[x]], surf->pal[srcPix[x]], (size_t)(cols[x + 1] - cols[x]));
+
+	// Repeated rows are plain copies of the first
+	const size_t len = sizeof(Colour) * (size_t)(cols[r + 1] - cols[l]);
+	for (int j = y0 + 1; j < y1; ++j)
+		SDL_memcpy(dstPixel(surf, cols[l], j), &dst[cols[l]], len);
+}
+
+typedef struct { Surface* surf; const int* cols, * rows; int beg, numRows, numBands; bool full; } CombineScaledBands;
+
+static void combineScaledBandJob(void* user, int index)
+{
+	const CombineScaledBands* bands = user;
+	Surface* surf = bands->surf;
+	const int beg = bands->beg + (int)((long)bands->numRows * index / bands->numBands);
+	const int end = bands->beg + (int)((long)bands->numRows * (index + 1) / bands->numBands);
+	for (int y = beg; y < end; ++y)
+	{
+		if (bands->full)
+		{
+			combineScaledRow(surf, bands->cols, bands->rows, y, 0, surf->w - 1);
+			continue;
+		}
+		const int row = y - surf->spanBeg;
+		for (uint32_t k = surf->spanRows[row]; k < surf->spanRows[row + 1]; ++k)
+			combineScaledRow(surf, bands->cols, bands->rows, y, surf->spans[k].l, surf->spans[k].r);
+	}
+}
+
+// Source pixel i covers destination pixels map[i]..map[i + 1], sampled at pixel centres
+void surfaceBuildScaleMap(int* map, int srcLen, int dstLen)
+{
+	int i = 0;
+	for (int x = 0; x < dstLen; ++x)
+	{
+		const int src = (int)(((int64_t)x * 2 + 1) * srcLen / ((int64_t)dstLen * 2));
+		while (i <= src)
+			map[i++] = x;
+	}
+	while (i <= srcLen)
+		map[i++] = dstLen;
+}
+
+void surfaceCombineScaled(Surface* surf, const int* cols, const int* rows, bool full, WorkPool* pool)
+{
+	if (!surf || !surf->dst || !cols || !rows)
+		return;
+	if (!full && (!surf->spans || surf->spanBeg < 0))
+		return;
+
+	CombineScaledBands bands = { surf, cols, rows, 0, surf->h, 1, full };
+	size_t pixels = (size_t)cols[surf->w] * (size_t)rows[surf->h];
+	if (!full)
+	{
+		bands.beg = surf->spanBeg;
+		bands.numRows = MIN(surf->h, surf->spanEnd + 1) - surf->spanBeg;
+		pixels = (size_t)cols[surf->w] * (size_t)(rows[bands.beg + bands.numRows] - rows[bands.beg]);
+	}
+	// Spans scale with the rest of the picture, near enough
+	surf->stats.pixels += full ? pixels : (size_t)((double)surf->spanPixels
+		* ((double)cols[surf->w] / (double)surf->w) * ((double)rows[surf->h] / (double)surf->h));
+
+	// Split by output size, upscaling multiplies the work per source row
+	size_t maxBands = MAX(1U, pixels / COMBINE_BAND_PIXELS);
+	bands.numBands = MIN((int)MIN(maxBands, (size_t)workPoolNumThreads(pool)), bands.numRows);
+	if (bands.numBands > 1)
+		workPoolRun(pool, combineScaledBandJob, &bands, bands.numBands);
+	else if (bands.numBands == 1)
+		combineScaledBandJob(&bands, 0);
+}
+
+void surfaceUpdate(Surface* surf, SDL_Texture* tex, WorkPool* pool)
+{
+	// Without a texture the combine is all there is
+	if (!surf || (!tex && !surf->comb))
+		return;
+
+	// Only the dirty rects can change after the first full combine
+	bool full = surf->combFull || (!surf->runs && !surf->spans);
+	if (!full && surf->spans && !surf->numDirty)
+		return;
+	const bool whole = full || !surf->spans;
+
+	// Combining into locked texture memory counts as combining, the unlock as the upload
+	TRACE_BEGIN(zone);
+	Uint64 start = SDL_GetTicksNS();
+	if (surf->comb)
+	{
+		surf->dst = surf->comb;
+		surf->dstStride = (size_t)surf->w;
+		surf->dstX = surf->dstY = 0;
+	}
+	else
+	{
+		// Combine straight into the texture, only valid if locked memory keeps its contents
+		void* pixels;
+		int pitch;
+		const SurfRect bounds = whole ? (SurfRect){ 0, 0, surf->w, surf->h } : surf->dirtyBounds;
+		const SDL_Rect rect = { bounds.x, bounds.y, bounds.w, bounds.h };
+		if (!SDL_LockTexture(tex, &rect, &pixels, &pitch))
+		{
+			TRACE_END(zone, "surfaceUpdate");
+			return;
+		}
+		surf->dst = (Colour*)pixels;
+		surf->dstStride = (size_t)pitch / sizeof(Colour);
+		surf->dstX = bounds.x;
+		surf->dstY = bounds.y;
+		surf->stats.bytes += sizeof(Colour) * (size_t)bounds.w * (size_t)bounds.h;
+	}
+
+	if (full)
+		surfaceCombine(surf);
+	else if (surf->runs)
+		surfaceCombineRuns(surf);
+	else
+		surfaceCombinePartial(surf, pool);
+	Uint64 now = SDL_GetTicksNS();
+	surf->stats.combineNs += now - start;
+	start = now;
+
+	if (surf->comb && tex)
 	{
-		SurfSpan span = surf->spans[i];
-		if (span.l >= 0)
+		int pitch = surf->w * (int)sizeof(Colour);
+		if (whole)
+		{
+			SDL_UpdateTexture(tex, NULL, surf->comb, pitch);
+			surf->stats.bytes += sizeof(Colour) * (size_t)surf->w * (size_t)surf->h;
+		}
+		else
 		{
-			if (span.inL < 0)
+			// Upload only the areas that can have changed
+			for (int i = 0; i < surf->numDirty; ++i)
 			{
-				for (int j = span.l; j <= span.r; ++j)
-					dst[j] = surf->pal[srcPix[j]];
+				const SurfRect* d = &surf->dirty[i];
+				const SDL_Rect rect = { d->x, d->y, d->w, d->h };
+				SDL_UpdateTexture(tex, &rect, &surf->comb[(size_t)d->y * surf->w + d->x], pitch);
+				surf->stats.bytes += sizeof(Colour) * (size_t)d->w * (size_t)d->h;
 			}
-			else
+		}
+	}
+	else if (!surf->comb)
+	{
+		SDL_UnlockTexture(tex);
+		surf->dst = NULL;
+	}
+	surf->stats.uploadNs += SDL_GetTicksNS() - start;
+	surf->combFull = false;
+	TRACE_END(zone, "surfaceUpdate");
+}
+
+void surfaceUpdatePalette(Surface* surf, SDL_Palette* palette)
+{
+	if (!surf || !palette)
+		return;
+
+	// Narrow the upload to the range of entries that changed since last time
+	int beg = 0, end = LBM_PAL_SIZE;
+	if (!surf->combFull)
+	{
+		for (; beg < end && surf->pal[beg] == surf->combPal[beg]; ++beg);
+		for (; end > beg && surf->pal[end - 1] == surf->combPal[end - 1]; --end);
+		if (beg == end)
+			return;
+	}
+
+	SDL_Color colours[LBM_PAL_SIZE];
+	for (int i = beg; i < end; ++i)
+	{
+		const Colour c = surf->pal[i];
+		colours[i - beg] = (SDL_Color){ COLOUR_R(c), COLOUR_G(c), COLOUR_B(c), SDL_ALPHA_OPAQUE };
+	}
+	const Uint64 start = SDL_GetTicksNS();
+	if (!SDL_SetPaletteColors(palette, colours, beg, end - beg))
+		return;
+	surf->stats.uploadNs += SDL_GetTicksNS() - start;
+	surf->stats.bytes += sizeof(SDL_Color) * (size_t)(end - beg);
+
+	SDL_memcpy(&surf->combPal[beg], &surf->pal[beg], sizeof(Colour) * (size_t)(end - beg));
+	surf->combFull = false;
+}
+
+static void combineSpansInRect(Surface* surf, const SDL_Rect* rect)
+{
+	const int x1 = rect->x + rect->w;
+	const int y0 = MAX(rect->y, surf->spanBeg);
+	const int y1 = MIN(rect->y + rect->h, MIN(surf->h, surf->spanEnd + 1));
+	for (int y = y0; y < y1; ++y)
+	{
+		const uint8_t* srcPix = surf->srcPix + (size_t)y * surf->w;
+		const int row = y - surf->spanBeg;
+		for (uint32_t k = surf->spanRows[row]; k < surf->spanRows[row + 1]; ++k)
+		{
+			const int l = MAX(rect->x, surf->spans[k].l), r = MIN(x1 - 1, surf->spans[k].r);
+			if (l <= r)
 			{
-				for (int j = span.l; j < span.inL; ++j)
-					dst[j] = surf->pal[srcPix[j]];
-				for (int j = span.inR + 1; j <= span.r; ++j)
-					dst[j] = surf->pal[srcPix[j]];
+				combineRow(dstPixel(surf, l, y), &srcPix[l], surf->pal, (size_t)(1 + r - l));
+				surf->stats.pixels += (size_t)(1 + r - l);
 			}
 		}
-
-		srcPix += surf->w;
-		dst += surf->w;
 	}
 }
 
-void surfaceUpdate(Surface* surf, SDL_Texture* tex)
+void surfaceUpdateTiles(Surface* surf, SDL_Texture* tex, WorkPool* pool, uint16_t ranges)
 {
 	if (!surf || !tex)
 		return;
+	if (surf->combFull || !surf->tileRanges || !surf->spans)
+	{
+		surfaceUpdate(surf, tex, pool);
+		return;
+	}
 
-	if (surf->spans)
-		surfaceCombinePartial(surf);
+	// Find which tiles use any of the changed ranges
+	int tx0 = surf->tilesW, ty0 = surf->tilesH, tx1 = -1, ty1 = -1;
+	for (int ty = 0; ty < surf->tilesH; ++ty)
+		for (int tx = 0; tx < surf->tilesW; ++tx)
+			if (surf->tileRanges[ty * surf->tilesW + tx] & ranges)
+			{
+				tx0 = MIN(tx0, tx), tx1 = MAX(tx1, tx);
+				ty0 = MIN(ty0, ty), ty1 = MAX(ty1, ty);
+			}
+	if (tx1 < 0 || surf->spanBeg < 0)
+	{
+		SDL_memcpy(surf->combPal, surf->pal, sizeof(Colour) * LBM_PAL_SIZE);
+		return;
+	}
+
+	Uint64 start = SDL_GetTicksNS();
+	if (surf->comb)
+	{
+		surf->dst = surf->comb;
+		surf->dstStride = (size_t)surf->w;
+		surf->dstX = surf->dstY = 0;
+	}
 	else
-		surfaceCombine(surf);
-	int pitch = surf->w * (int)sizeof(Colour);
-	SDL_UpdateTexture(tex, NULL, surf->comb, pitch);
+	{
+		void* pixels;
+		int pitch;
+		const SDL_Rect rect = { tx0 * TILE_SIZE, ty0 * TILE_SIZE,
+			MIN(surf->w, (tx1 + 1) * TILE_SIZE) - tx0 * TILE_SIZE,
+			MIN(surf->h, (ty1 + 1) * TILE_SIZE) - ty0 * TILE_SIZE };
+		if (!SDL_LockTexture(tex, &rect, &pixels, &pitch))
+			return;
+		surf->dst = (Colour*)pixels;
+		surf->dstStride = (size_t)pitch / sizeof(Colour);
+		surf->dstX = rect.x;
+		surf->dstY = rect.y;
+		surf->stats.bytes += sizeof(Colour) * (size_t)rect.w * (size_t)rect.h;
+	}
+
+	for (int ty = ty0; ty <= ty1; ++ty)
+	{
+		const uint16_t* tiles = &surf->tileRanges[ty * surf->tilesW];
+		for (int tx = tx0; tx <= tx1;)
+		{
+			if (!(tiles[tx] & ranges))
+			{
+				++tx;
+				continue;
+			}
+
+			// Combine & upload horizontal runs of tiles together
+			const int beg = tx;
+			while (++tx <= tx1 && (tiles[tx] & ranges));
+			const SDL_Rect rect = { beg * TILE_SIZE, ty * TILE_SIZE,
+				MIN(surf->w, tx * TILE_SIZE) - beg * TILE_SIZE,
+				MIN(surf->h, (ty + 1) * TILE_SIZE) - ty * TILE_SIZE };
+			combineSpansInRect(surf, &rect);
+			if (surf->comb)
+			{
+				const Uint64 now = SDL_GetTicksNS();
+				surf->stats.combineNs += now - start;
+				SDL_UpdateTexture(tex, &rect, &surf->comb[(size_t)rect.y * surf->w + rect.x],
+					surf->w * (int)sizeof(Colour));
+				surf->stats.bytes += sizeof(Colour) * (size_t)rect.w * (size_t)rect.h;
+				start = SDL_GetTicksNS();
+				surf->stats.uploadNs += start - now;
+			}
+		}
+	}
+
+	const Uint64 now = SDL_GetTicksNS();
+	surf->stats.combineNs += now - start;
+	if (!surf->comb)
+	{
+		SDL_UnlockTexture(tex);
+		surf->dst = NULL;
+		surf->stats.uploadNs += SDL_GetTicksNS() - now;
+	}
+
+	// Only the given ranges have changed, so everything else is still current
+	SDL_memcpy(surf->combPal, surf->pal, sizeof(Colour) * LBM_PAL_SIZE);
 }
@@ -2,8 +2,22 @@
 #define SURFACE_H
 
 #include "lbm.h"
+#include "workpool.h"
+#include <stdbool.h>
 
-typedef struct SurfSpan { int16_t l, r, inL, inR; } SurfSpan;
+typedef struct SurfSpan { int16_t l, r; } SurfSpan;
+typedef struct SurfRun { uint16_t x, y, len; } SurfRun;
+typedef struct SurfRect { int x, y, w, h; } SurfRect;
+
+#define SURFACE_MAX_DIRTY 8
+
+// What the combines & uploads have done since the reader last cleared it
+typedef struct SurfaceStats
+{
+	uint64_t combineNs, uploadNs;
+	size_t   pixels;  // Combined, scaled combines count output pixels
+	size_t   bytes;   // Sent to the texture or palette
+} SurfaceStats;
 
 typedef struct
 {
@@ -11,27 +25,81 @@ typedef struct
 
 	Colour    srcPal[LBM_PAL_SIZE];
 	Colour    pal[LBM_PAL_SIZE];
+	// srcPal converted up front for the Oklab & OkLCh blends
+	float     srcOklab[LBM_PAL_SIZE][3];
+	float     srcOklch[LBM_PAL_SIZE][3];
 	uint8_t*  srcPix;
 	Colour*   comb;
+	bool      combFull;
+
+	// Where combines are written to, either comb or locked texture memory starting at dstX, dstY
+	Colour*   dst;
+	size_t    dstStride;
+	int       dstX, dstY;
+
+	// Cycling intervals for rows spanBeg..spanEnd, row i owns spans[spanRows[i]..spanRows[i + 1]]
 	SurfSpan* spans;
 	int       spanBufLen;
+	uint32_t* spanRows;
+	int       spanRowBufLen;
 	int       spanBeg;
 	int       spanEnd;
+	size_t    spanPixels;
+
+	// Areas that can change between frames, derived from spans
+	SurfRect  dirty[SURFACE_MAX_DIRTY];
+	int       numDirty;
+	SurfRect  dirtyBounds;
+
+	// Mask of the ranges used within each tile, in rows of tilesW
+	uint16_t* tileRanges;
+	int       tilesW, tilesH;
+
+	// Inverted index of cycling pixel runs, sorted by palette index
+	Colour    combPal[LBM_PAL_SIZE];
+	SurfRun*  runs;
+	uint32_t  runOfs[LBM_PAL_SIZE + 1];
+
+	SurfaceStats stats;
 } Surface;
 
 #define SURFACE_CLEAR() (Surface){  \
 	.w = 0, .h = 0,                 \
 	.srcPix = NULL,                 \
-	.comb = NULL,                   \
+	.comb = NULL, .combFull = true, \
+	.dst = NULL, .dstStride = 0,    \
+	.dstX = 0, .dstY = 0,           \
 	.spans = NULL, .spanBufLen = 0, \
-	.spanBeg = 0, .spanEnd = 0 }
+	.spanRows = NULL,               \
+	.spanRowBufLen = 0,             \
+	.spanBeg = 0, .spanEnd = 0,     \
+	.spanPixels = 0,                \
+	.numDirty = 0,                  \
+	.tileRanges = NULL,             \
+	.tilesW = 0, .tilesH = 0,       \
+	.runs = NULL,                   \
+	.stats = { 0, 0, 0, 0 } }
+
+// Picks kernels & fills the tables every surface shares, only the first call does anything
+//  & surfaceInit makes it, call it first to keep that work off threads setting up surfaces
+void surfaceSetup(void);
 
 int surfaceInit(Surface* surf,
 	int w, int h,
 	const uint8_t* pix,
 	const Colour pal[]);
 
+typedef enum
+{
+	SURFACE_SCALE_NEAREST,  // Pixel under each reduced pixel's centre
+	SURFACE_SCALE_MAJORITY  // Most common index in each reduced pixel's block
+} SurfaceScaleMode;
+
+// Reduced copy of src at w x h (no bigger than src) with spans derived from src's, for cheap thumbnails
+int surfaceInitScaled(Surface* surf, const Surface* src, int w, int h, SurfaceScaleMode mode);
+
 void surfaceFree(Surface* surf);
+int surfaceAllocComb(Surface* surf);
 
 void surfacePalShiftRight(Surface* surf, uint8_t hi, uint8_t low);
 void surfacePalShiftLeft(Surface* surf, uint8_t hi, uint8_t low);
@@ -41,16 +109,38 @@ void surfaceRangeSrgb(Surface* surf, uint8_t hi, uint8_t low, int cycle, double
 void surfaceRangeLinear(Surface* surf, uint8_t hi, uint8_t low, int cycle, double tween);
 void surfaceRangeHsluv(Surface* surf, uint8_t hi, uint8_t low, int cycle, double tween);
 void surfaceRangeLab(Surface* surf, uint8_t hi, uint8_t low, int cycle, double tween);
+void surfaceRangeOklab(Surface* surf, uint8_t hi, uint8_t low, int cycle, double tween);
+void surfaceRangeOklch(Surface* surf, uint8_t hi, uint8_t low, int cycle, double tween);
 
 int surfaceComputeSpans(Surface* surf,
 	const uint8_t hi[], const uint8_t low[],
-	const int16_t rate[], int numRanges);
+	const int16_t rate[], int numRanges,
+	WorkPool* pool);
 int surfaceLoadSpans(Surface* surf, const void* chunk, size_t size);
+int surfaceLoadSpans2(Surface* surf, const void* chunk, size_t size);
+// Writes spans in the same layout, returns the size needed (0 if unrepresentable)
+size_t surfaceSaveSpans2(const Surface* surf, void* chunk, size_t size);
+int surfaceComputeRuns(Surface* surf,
+	const uint8_t hi[], const uint8_t low[],
+	const int16_t rate[], int numRanges);
+int surfaceComputeTiles(Surface* surf,
+	const uint8_t hi[], const uint8_t low[],
+	const int16_t rate[], int numRanges);
+
 void surfaceCombine(Surface* surf);
-void surfaceCombinePartial(Surface* surf);
+void surfaceCombinePartial(Surface* surf, WorkPool* pool);
+void surfaceCombineRuns(Surface* surf);
+// Nearest neighbour combine into dst, source column x covers dst columns cols[x]..cols[x + 1] & likewise rows
+void surfaceCombineScaled(Surface* surf, const int* cols, const int* rows, bool full, WorkPool* pool);
+// Maps srcLen + 1 source pixel edges to their destination pixels for surfaceCombineScaled()
+void surfaceBuildScaleMap(int* map, int srcLen, int dstLen);
 
 typedef struct SDL_Texture SDL_Texture;
+typedef struct SDL_Palette SDL_Palette;
 
-void surfaceUpdate(Surface* surf, SDL_Texture* tex);
+// A NULL texture only combines into comb
+void surfaceUpdate(Surface* surf, SDL_Texture* tex, WorkPool* pool);
+void surfaceUpdateTiles(Surface* surf, SDL_Texture* tex, WorkPool* pool, uint16_t ranges);
+void surfaceUpdatePalette(Surface* surf, SDL_Palette* palette);
 
 #endif //SURFACE_H
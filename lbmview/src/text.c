@@ -2,6 +2,7 @@
 #include "text.h"
 #include "font.h"
 #include <SDL3/SDL.h>
+#include <stdlib.h>
 #include <string.h>
 
 
@@ -57,45 +58,97 @@ static void handleControlChar(int c, int xorig, int textScale, int* restrict x,
 	}
 }
 
-void textComputeArea(int textScale, int* restrict w, int* restrict h, const char* restrict str)
+int textLayout(TextLayout* layout, int textScale, const char* restrict str)
 {
+	if (!layout || !str)
+		return -1;
+
 	const size_t len = strlen(str);
+	if ((int)len > layout->bufGlyphs)
+	{
+		SDL_Vertex* verts = realloc(layout->verts, sizeof(SDL_Vertex) * 4 * len);
+		if (verts)
+			layout->verts = verts;
+		int* indices = realloc(layout->indices, sizeof(int) * 6 * len);
+		if (indices)
+			layout->indices = indices;
+		if (!verts || !indices)
+			return -1;
+		layout->bufGlyphs = (int)len;
+	}
 
-	int x = 0, y = 0, ww = 0;
+	const float texW = (float)sizeof(fontGlyphBitmaps), fTextScale = (float)textScale;
+	const SDL_FColor white = { 1.f, 1.f, 1.f, 1.f };
+	int x = 0, y = 0, w = 0, n = 0;
 	for (size_t i = 0; i < len; ++i)
 	{
 		int offset, size, c = (unsigned char)str[i];
-		if (fontGetGlyph(c, &offset, &size))
-			x += (size + fontGetKerning((unsigned char)str[i + 1], c)) * textScale;
-		else
+		if (!fontGetGlyph(c, &offset, &size))
+		{
 			handleControlChar(c, 0, textScale, &x, &y);
+			continue;
+		}
+
+		const float x0 = (float)x, y0 = (float)y;
+		const float x1 = x0 + (float)size * fTextScale, y1 = y0 + 8.f * fTextScale;
+		const float u0 = (float)offset / texW, u1 = (float)(offset + size) / texW;
+		SDL_Vertex* v = &layout->verts[n * 4];
+		v[0] = (SDL_Vertex){ { x0, y0 }, white, { u0, 0.f } };
+		v[1] = (SDL_Vertex){ { x1, y0 }, white, { u1, 0.f } };
+		v[2] = (SDL_Vertex){ { x1, y1 }, white, { u1, 1.f } };
+		v[3] = (SDL_Vertex){ { x0, y1 }, white, { u0, 1.f } };
+		int* idx = &layout->indices[n * 6];
+		const int base = n * 4;
+		idx[0] = base;
+		idx[1] = base + 1;
+		idx[2] = base + 2;
+		idx[3] = base;
+		idx[4] = base + 2;
+		idx[5] = base + 3;
+		++n;
+
+		x += (size + fontGetKerning((unsigned char)str[i + 1], c)) * textScale;
+		if (x > w)
+			w = x;
 	}
 
-	if (x > ww)
-		ww = x;
-	(*w) = ww;
-	(*h) = y + 8 * textScale;
+	layout->numGlyphs = n;
+	layout->w = w;
+	layout->h = y + 8 * textScale;
+	layout->x = layout->y = 0.f;
+	layout->alpha = 1.f;
+	return 0;
 }
 
-void textDraw(const Font* font, int textScale, int x, int y, const char* restrict str)
+void textLayoutFree(TextLayout* layout)
 {
-	if (!font || !font->r || !font->tex || !str)
+	if (!layout)
 		return;
+	free(layout->verts);
+	free(layout->indices);
+	(*layout) = TEXTLAYOUT_CLEAR();
+}
 
-	const size_t len = strlen(str);
-	const int xorig = x;
+void textDrawLayout(const Font* font, TextLayout* layout, float x, float y, float alpha)
+{
+	if (!font || !font->r || !font->tex || !layout || !layout->numGlyphs)
+		return;
 
-	for (size_t i = 0; i < len; ++i)
+	// Geometry ignores texture modulation, so moves & fades are applied to the vertices themselves
+	const float dx = x - layout->x, dy = y - layout->y;
+	if (dx != 0.f || dy != 0.f || alpha != layout->alpha)
 	{
-		int offset, size, c = (unsigned char)str[i];
-		if (fontGetGlyph(c, &offset, &size))
+		for (int i = 0; i < layout->numGlyphs * 4; ++i)
 		{
-			const float fSize = (float)size, fTextScale = (float)textScale;
-			SDL_FRect src = { (float)offset, 0.f, fSize, 8.f };
-			SDL_FRect dst = { (float)x, (float)y, fSize * fTextScale, 8.f * fTextScale };
-			SDL_RenderTexture(font->r, font->tex, &src, &dst);
-			x += (size + fontGetKerning((unsigned char)str[i + 1], c)) * textScale;
+			layout->verts[i].position.x += dx;
+			layout->verts[i].position.y += dy;
+			layout->verts[i].color.a = alpha;
 		}
-		else handleControlChar(c, xorig, textScale, &x, &y);
+		layout->x = x;
+		layout->y = y;
+		layout->alpha = alpha;
 	}
+	SDL_RenderGeometry(font->r, font->tex,
+		layout->verts, layout->numGlyphs * 4,
+		layout->indices, layout->numGlyphs * 6);
 }
@@ -13,8 +13,29 @@ typedef struct Font
 
 } Font;
 
+typedef struct SDL_Vertex SDL_Vertex;
+
+// Glyph quads laid out once, then drawn as a single batch
+typedef struct TextLayout
+{
+	SDL_Vertex* verts;
+	int* indices;
+	int numGlyphs, bufGlyphs;
+	int w, h;
+	// Where the quads currently sit & their opacity, only touched when a draw changes them
+	float x, y, alpha;
+
+} TextLayout;
+
+#define TEXTLAYOUT_CLEAR() (TextLayout){ \
+	.verts = NULL, .indices = NULL,      \
+	.numGlyphs = 0, .bufGlyphs = 0,      \
+	.w = 0, .h = 0,                      \
+	.x = 0.f, .y = 0.f, .alpha = 1.f }
+
 void textCreateFontTexture(Font* font);
-void textComputeArea(int textScale, int* restrict w, int* restrict h, const char* restrict str);
-void textDraw(const Font* font, int textScale, int x, int y, const char* restrict str);
+int textLayout(TextLayout* layout, int textScale, const char* restrict str);
+void textLayoutFree(TextLayout* layout);
+void textDrawLayout(const Font* font, TextLayout* layout, float x, float y, float alpha);
 
 #endif//TEXT_H
@@ -0,0 +1,130 @@
+/* trace.c - (C) 2025 a dinosaur (zlib) */
+#include "trace.h"
+#include <SDL3/SDL.h>
+#include "util.h"
+#include <stdio.h>
+
+// Events kept per thread, the oldest are overwritten once a ring is full
+#define TRACE_RING_SIZE 0x8000
+
+typedef struct
+{
+	const char* name;
+	uint64_t start, dur;
+} TraceEvent;
+
+typedef struct TraceRing
+{
+	struct TraceRing* next;
+	SDL_ThreadID thread;
+	const char* threadName;
+	SDL_AtomicU32 head;  // Events ever recorded, only advanced by the owning thread
+	TraceEvent events[TRACE_RING_SIZE];
+} TraceRing;
+
+static void* rings = NULL;  // Every thread's ring, pushed lock-free & kept until shutdown
+static SDL_TLSID ringTls;
+
+
+static TraceRing* threadRing(void)
+{
+	TraceRing* ring = SDL_GetTLS(&ringTls);
+	if (ring)
+		return ring;
+	if (!(ring = SDL_calloc(1, sizeof(TraceRing))))
+		return NULL;
+	ring->thread = SDL_GetCurrentThreadID();
+	if (!SDL_SetTLS(&ringTls, ring, NULL))
+	{
+		SDL_free(ring);
+		return NULL;
+	}
+	do
+		ring->next = SDL_GetAtomicPointer(&rings);
+	while (!SDL_CompareAndSwapAtomicPointer(&rings, ring->next, ring));
+	return ring;
+}
+
+uint64_t traceNow(void)
+{
+	return SDL_GetTicksNS();
+}
+
+void traceZone(const char* name, uint64_t start)
+{
+	const uint64_t end = SDL_GetTicksNS();
+	TraceRing* ring = threadRing();
+	if (!ring)
+		return;
+	const uint32_t head = SDL_GetAtomicU32(&ring->head);
+	ring->events[head % TRACE_RING_SIZE] = (TraceEvent){ name, start, end - start };
+	// Publishes the event before a dump can read it
+	SDL_SetAtomicU32(&ring->head, head + 1U);
+}
+
+void traceThreadName(const char* name)
+{
+	TraceRing* ring = threadRing();
+	if (ring)
+		ring->threadName = name;
+}
+
+int traceDump(const char* path)
+{
+	// Rings are copied out before writing, so their threads never wait on the file
+	TraceEvent* events = SDL_malloc(sizeof(TraceEvent) * TRACE_RING_SIZE);
+	if (!events)
+		return -1;
+	FILE* f = fopen(path, "w");
+	if (!f)
+	{
+		SDL_free(events);
+		return -1;
+	}
+
+	const char* sep = "";
+	fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+	for (TraceRing* ring = SDL_GetAtomicPointer(&rings); ring; ring = ring->next)
+	{
+		const uint64_t tid = (uint64_t)ring->thread;
+		const char* threadName = ring->threadName;
+		if (threadName)
+		{
+			fprintf(f, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%" SDL_PRIu64
+				",\"args\":{\"name\":\"%s\"}}", sep, tid, threadName);
+			sep = ",";
+		}
+
+		const uint32_t head = SDL_GetAtomicU32(&ring->head);
+		uint32_t num = MIN(head, TRACE_RING_SIZE);
+		for (uint32_t i = head - num; i != head; ++i)
+			events[i % TRACE_RING_SIZE] = ring->events[i % TRACE_RING_SIZE];
+		// Drop whatever the thread overwrote while copying, including the slot it may be writing now
+		const uint32_t overrun = SDL_GetAtomicU32(&ring->head) - head;
+		num = overrun >= TRACE_RING_SIZE - 1U ? 0 : MIN(num, TRACE_RING_SIZE - 1U - overrun);
+
+		for (uint32_t i = head - num; i != head; ++i)
+		{
+			const TraceEvent* e = &events[i % TRACE_RING_SIZE];
+			fprintf(f, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%" SDL_PRIu64
+				",\"ts\":%.3f,\"dur\":%.3f}", sep, e->name, tid,
+				(double)e->start / 1000.0, (double)e->dur / 1000.0);
+			sep = ",";
+		}
+	}
+	fprintf(f, "\n]}\n");
+	SDL_free(events);
+	return fclose(f) ? -1 : 0;
+}
+
+void traceShutdown(void)
+{
+	TraceRing* ring = SDL_SetAtomicPointer(&rings, NULL);
+	while (ring)
+	{
+		TraceRing* next = ring->next;
+		SDL_free(ring);
+		ring = next;
+	}
+	SDL_SetTLS(&ringTls, NULL, NULL);
+}
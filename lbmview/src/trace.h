@@ -0,0 +1,32 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+// Zones timed per thread & dumped as Chrome trace events, for chrome://tracing or ui.perfetto.dev,
+//  without ENABLE_TRACE every macro expands to nothing
+#ifdef ENABLE_TRACE
+
+uint64_t traceNow(void);
+// Records a zone from start until now on the calling thread's ring,
+//  name is kept as is so it must be a string literal
+void traceZone(const char* name, uint64_t start);
+void traceThreadName(const char* name);
+// Writes every thread's recorded zones as a Chrome JSON trace, recording carries on meanwhile
+int traceDump(const char* path);
+// Frees all rings, every other traced thread must have exited
+void traceShutdown(void);
+
+# define TRACE_BEGIN(ZONE)     const uint64_t ZONE = traceNow()
+# define TRACE_END(ZONE, NAME) traceZone((NAME), (ZONE))
+# define TRACE_THREAD(NAME)    traceThreadName(NAME)
+
+#else
+
+# define TRACE_BEGIN(ZONE)     ((void)0)
+# define TRACE_END(ZONE, NAME) ((void)0)
+# define TRACE_THREAD(NAME)    ((void)0)
+
+#endif
+
+#endif//TRACE_H
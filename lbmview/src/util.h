@@ -118,6 +118,15 @@ static inline double FORCE_INLINE efmod(double x, double d) { double r = fmod(x,
 static inline float FORCE_INLINE efmodf(float x, float d) { float r = fmodf(x, d); return r < 0.0f ? r + d : r; }
 #define DEG_SHORTEST(S, E) (efmod((S) - (E) + 180.0, 360.0) - 180.0)
 
+#if defined(__GNUC__) || defined(__clang__)
+# define ctz64(X) __builtin_ctzll((X))
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+# include <intrin.h>
+static inline int FORCE_INLINE ctz64(uint64_t v) { unsigned long i; _BitScanForward64(&i, v); return (int)i; }
+#else
+static inline int FORCE_INLINE ctz64(uint64_t v) { int i = 0; for (; !(v & 0x1); v >>= 1) ++i; return i; }
+#endif
+
 #define LERP(A, B, X) ((A) * (1 - (X)) + (B) * (X))
 #define DEGLERP(A, B, X) efmod(LERP((A), (A) - DEG_SHORTEST((A), (B)), (X)), 360.0)
 
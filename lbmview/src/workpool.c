@@ -0,0 +1,161 @@
+/* workpool.c - (C) 2025 a dinosaur (zlib) */
+#include "workpool.h"
+#include "trace.h"
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+
+
+#define WORKPOOL_MAX_WORKERS 31
+
+struct WorkPool
+{
+	SDL_Mutex*     lock;
+	SDL_Condition* wake;
+	SDL_Condition* done;
+	SDL_Thread*    threads[WORKPOOL_MAX_WORKERS];
+	int            numWorkers;
+
+	// Current batch, guarded by lock except for the job counter
+	WorkPoolJob    job;
+	void*          user;
+	int            numJobs;
+	SDL_AtomicInt  nextJob;
+	int            numBusy;
+	unsigned       generation;
+	bool           quit;
+};
+
+static void runJobs(WorkPool* pool, WorkPoolJob job, void* user, int numJobs)
+{
+	int index;
+	TRACE_BEGIN(zone);
+	while ((index = SDL_AddAtomicInt(&pool->nextJob, 1)) < numJobs)
+		job(user, index);
+	TRACE_END(zone, "workPoolJobs");
+}
+
+static int SDLCALL workerMain(void* data)
+{
+	WorkPool* pool = data;
+	unsigned generation = 0;
+	TRACE_THREAD("combine");
+
+	SDL_LockMutex(pool->lock);
+	while (true)
+	{
+		while (!pool->quit && generation == pool->generation)
+			SDL_WaitCondition(pool->wake, pool->lock);
+		if (pool->quit)
+			break;
+		generation = pool->generation;
+		WorkPoolJob job = pool->job;
+		void* user = pool->user;
+		int numJobs = pool->numJobs;
+		SDL_UnlockMutex(pool->lock);
+
+		runJobs(pool, job, user, numJobs);
+
+		SDL_LockMutex(pool->lock);
+		if (--pool->numBusy == 0)
+			SDL_SignalCondition(pool->done);
+	}
+	SDL_UnlockMutex(pool->lock);
+	return 0;
+}
+
+WorkPool* workPoolCreate(int numWorkers)
+{
+	WorkPool* pool = SDL_malloc(sizeof(WorkPool));
+	if (!pool)
+		return NULL;
+
+	(*pool) = (WorkPool)
+	{
+		.lock = SDL_CreateMutex(),
+		.wake = SDL_CreateCondition(),
+		.done = SDL_CreateCondition(),
+		.numWorkers = 0,
+		.job = NULL,
+		.user = NULL,
+		.numJobs = 0,
+		.numBusy = 0,
+		.generation = 0,
+		.quit = false
+	};
+	SDL_SetAtomicInt(&pool->nextJob, 0);
+	if (!pool->lock || !pool->wake || !pool->done)
+	{
+		workPoolFree(pool);
+		return NULL;
+	}
+
+	// A pool without workers is still usable, jobs just run on the calling thread
+	numWorkers = SDL_clamp(numWorkers, 0, WORKPOOL_MAX_WORKERS);
+	for (int i = 0; i < numWorkers; ++i)
+	{
+		pool->threads[i] = SDL_CreateThread(workerMain, "combine", pool);
+		if (!pool->threads[i])
+			break;
+		++pool->numWorkers;
+	}
+
+	return pool;
+}
+
+void workPoolFree(WorkPool* pool)
+{
+	if (!pool)
+		return;
+
+	if (pool->lock)
+	{
+		SDL_LockMutex(pool->lock);
+		pool->quit = true;
+		SDL_BroadcastCondition(pool->wake);
+		SDL_UnlockMutex(pool->lock);
+	}
+	for (int i = 0; i < pool->numWorkers; ++i)
+		SDL_WaitThread(pool->threads[i], NULL);
+
+	SDL_DestroyCondition(pool->done);
+	SDL_DestroyCondition(pool->wake);
+	SDL_DestroyMutex(pool->lock);
+	SDL_free(pool);
+}
+
+int workPoolNumThreads(const WorkPool* pool)
+{
+	return pool ? 1 + pool->numWorkers : 1;
+}
+
+void workPoolRun(WorkPool* pool, WorkPoolJob job, void* user, int numJobs)
+{
+	if (!job || numJobs <= 0)
+		return;
+
+	// Skip synchronisation entirely for single jobs
+	if (!pool || !pool->numWorkers || numJobs == 1)
+	{
+		for (int i = 0; i < numJobs; ++i)
+			job(user, i);
+		return;
+	}
+
+	SDL_LockMutex(pool->lock);
+	pool->job = job;
+	pool->user = user;
+	pool->numJobs = numJobs;
+	pool->numBusy = pool->numWorkers;
+	SDL_SetAtomicInt(&pool->nextJob, 0);
+	++pool->generation;
+	SDL_BroadcastCondition(pool->wake);
+	SDL_UnlockMutex(pool->lock);
+
+	// Calling thread pitches in, then joins
+	runJobs(pool, job, user, numJobs);
+
+	SDL_LockMutex(pool->lock);
+	while (pool->numBusy > 0)
+		SDL_WaitCondition(pool->done, pool->lock);
+	SDL_UnlockMutex(pool->lock);
+}
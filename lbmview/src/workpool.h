@@ -0,0 +1,14 @@
+#ifndef WORKPOOL_H
+#define WORKPOOL_H
+
+typedef struct WorkPool WorkPool;
+
+typedef void (*WorkPoolJob)(void* user, int index);
+
+WorkPool* workPoolCreate(int numWorkers);
+void workPoolFree(WorkPool* pool);
+
+int workPoolNumThreads(const WorkPool* pool);
+void workPoolRun(WorkPool* pool, WorkPoolJob job, void* user, int numJobs);
+
+#endif//WORKPOOL_H
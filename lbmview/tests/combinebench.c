@@ -0,0 +1,102 @@
+/* combinebench.c - (C) 2025 a dinosaur (zlib) */
+// Times every row kernel this machine can run against the plain per-pixel loop they replaced,
+//  failing if any of them disagrees with it
+#include "combine.c"
+#include <SDL3/SDL_timer.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+typedef struct
+{
+	const char* name;
+	CombineRowKernel kernel;
+	bool usable;
+} BenchKernel;
+
+// The loop surfaceCombine used to run, left unrestricted as it was
+static void combineRowLoop(Colour* dst, const uint8_t* src, const Colour* pal, size_t len)
+{
+	for (size_t i = 0; i < len; ++i)
+		dst[i] = pal[src[i]];
+}
+
+static double bestOf(CombineRowKernel kernel, Colour* dst, const uint8_t* src, const Colour* pal, size_t len, int reps)
+{
+	Uint64 best = UINT64_MAX;
+	for (int i = 0; i < reps; ++i)
+	{
+		const Uint64 start = SDL_GetTicksNS();
+		kernel(dst, src, pal, len);
+		best = MIN(best, SDL_GetTicksNS() - start);
+	}
+	return (double)best / 1000000.0;
+}
+
+int main(int argc, char* argv[])
+{
+	const int w = argc > 1 ? atoi(argv[1]) : 3840;
+	const int h = argc > 2 ? atoi(argv[2]) : 2160;
+	const int reps = argc > 3 ? atoi(argv[3]) : 20;
+	if (w <= 0 || h <= 0 || reps <= 0)
+	{
+		fprintf(stderr, "Usage: %s [width height reps]\n", argv[0]);
+		return 1;
+	}
+
+	const BenchKernel kernels[] =
+	{
+		{ "Previous loop", combineRowLoop, true },
+		{ "Scalar", combineRowScalar, true },
+#ifdef COMBINE_HAVE_AVX2
+		{ "AVX2", combineRowAvx2, SDL_HasAVX2() },
+#endif
+#ifdef COMBINE_HAVE_NEON
+		{ "NEON", combineRowNeon, SDL_HasNEON() },
+#endif
+	};
+
+	const size_t len = (size_t)w * (size_t)h;
+	uint8_t* src = malloc(len);
+	Colour* want = malloc(sizeof(Colour) * len);
+	Colour* got = malloc(sizeof(Colour) * len);
+	if (!src || !want || !got)
+		return 1;
+	Colour pal[LBM_PAL_SIZE];
+	srand(1);
+	for (size_t i = 0; i < len; ++i)
+		src[i] = (uint8_t)rand();
+	for (unsigned i = 0; i < LBM_PAL_SIZE; ++i)
+		pal[i] = (Colour)rand() ^ ((Colour)rand() << 16);
+	combineRowLoop(want, src, pal, len);
+
+	int failed = 0;
+	printf("Full frame combine at %dx%d (best of %d)\n", w, h, reps);
+	for (size_t k = 0; k < SDL_arraysize(kernels); ++k)
+	{
+		if (!kernels[k].usable)
+			continue;
+		// Every short length too, so the tails past each kernel's block size get checked
+		for (size_t n = 0; n < 67 && n <= len; ++n)
+		{
+			kernels[k].kernel(got, &src[len - n], pal, n);
+			if (SDL_memcmp(got, &want[len - n], sizeof(Colour) * n))
+			{
+				fprintf(stderr, "%s: wrong result for %zu pixels\n", kernels[k].name, n);
+				++failed;
+				break;
+			}
+		}
+		const double ms = bestOf(kernels[k].kernel, got, src, pal, len, reps);
+		if (SDL_memcmp(got, want, sizeof(Colour) * len))
+		{
+			fprintf(stderr, "%s: wrong result for the full frame\n", kernels[k].name);
+			++failed;
+		}
+		printf("  %-16s%.2f ms\n", kernels[k].name, ms);
+	}
+
+	free(got);
+	free(want);
+	free(src);
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,173 @@
+/* encodetest.c - (C) 2025 a dinosaur (zlib) */
+// Round trips random images through the GIF LZW encoder & a strict decoder,
+//  which rejects codes at the wrong width rather than guessing like lenient ones
+#include "encode.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+
+typedef struct
+{
+	const uint8_t* data;
+	size_t len, pos;
+	uint32_t bits;
+	int numBits;
+} BitReader;
+
+static int readCode(BitReader* r, int size)
+{
+	while (r->numBits < size)
+	{
+		if (r->pos >= r->len)
+			return -1;
+		r->bits |= (uint32_t)r->data[r->pos++] << r->numBits;
+		r->numBits += 8;
+	}
+	const int code = (int)(r->bits & ((1U << size) - 1U));
+	r->bits >>= size;
+	r->numBits -= size;
+	return code;
+}
+
+// Decodes into out, returning the number of pixels or -1 on anything malformed
+static long decodeGifLzw(const uint8_t* gif, size_t gifLen, uint8_t* out, size_t outLen)
+{
+	if (gifLen < 2)
+		return -1;
+	const int minCodeSize = gif[0];
+	if (minCodeSize < 2 || minCodeSize > 8)
+		return -1;
+
+	// Join the sub-blocks, which must end in an empty one with nothing after it
+	uint8_t* data = malloc(gifLen);
+	size_t len = 0, pos = 1;
+	while (pos < gifLen && gif[pos])
+	{
+		const size_t block = gif[pos++];
+		if (pos + block > gifLen)
+		{
+			free(data);
+			return -1;
+		}
+		memcpy(&data[len], &gif[pos], block);
+		len += block;
+		pos += block;
+	}
+	if (pos + 1 != gifLen)
+	{
+		free(data);
+		return -1;
+	}
+
+	static uint16_t prefixes[4096];
+	static uint8_t suffixes[4096], stack[4096];
+	const int clear = 1 << minCodeSize, end = clear + 1;
+	int size = minCodeSize + 1, next = clear + 2, prev = -1;
+	uint8_t first = 0;
+	size_t num = 0;
+	BitReader r = { data, len, 0, 0, 0 };
+	long res = -1;
+	while (true)
+	{
+		const int code = readCode(&r, size);
+		if (code < 0)
+			break;
+		if (code == clear)
+		{
+			size = minCodeSize + 1;
+			next = clear + 2;
+			prev = -1;
+			continue;
+		}
+		if (code == end)
+		{
+			// Only the padding of the last byte may follow
+			if (r.pos == r.len && r.bits == 0)
+				res = (long)num;
+			break;
+		}
+		if (prev < 0)
+		{
+			if (code >= clear || num >= outLen)
+				break;
+			out[num++] = first = (uint8_t)code;
+			prev = code;
+			continue;
+		}
+		if (code > next || (code == next && next >= 4096))
+			break;
+
+		int depth = 0, c = code;
+		if (code == next)
+		{
+			stack[depth++] = first;
+			c = prev;
+		}
+		while (c >= clear)
+		{
+			stack[depth++] = suffixes[c];
+			c = prefixes[c];
+		}
+		stack[depth++] = first = (uint8_t)c;
+		if (num + (size_t)depth > outLen)
+			break;
+		while (depth)
+			out[num++] = stack[--depth];
+
+		if (next < 4096)
+		{
+			prefixes[next] = (uint16_t)prev;
+			suffixes[next] = first;
+			if (++next == 1 << size && size < 12)
+				++size;
+		}
+		prev = code;
+	}
+	free(data);
+	return res;
+}
+
+static bool roundTrip(const uint8_t* pix, int w, int h, int minCodeSize)
+{
+	EncodeBuf buf = ENCODEBUF_CLEAR();
+	const size_t len = (size_t)w * (size_t)h;
+	uint8_t* out = malloc(len);
+	bool ok = out && !encodeGifLzw(&buf, pix, (size_t)w, w, h, minCodeSize)
+		&& decodeGifLzw(buf.ptr, buf.len, out, len) == (long)len
+		&& !memcmp(out, pix, len);
+	free(out);
+	encodeFree(&buf);
+	return ok;
+}
+
+int main(int argc, char* argv[])
+{
+	const int count = argc > 1 ? atoi(argv[1]) : 2000;
+	int failed = 0;
+	srand(1);
+	for (int i = 0; i < count; ++i)
+	{
+		// Anything from single pixels to enough noise to fill & clear the table a few times
+		const int minCodeSize = 2 + rand() % 7;
+		const int colours = 1 + rand() % (1 << minCodeSize);
+		const int w = 1 + rand() % 200, h = 1 + rand() % 100;
+		const int runs = 1 + rand() % 16;
+		uint8_t* pix = malloc((size_t)w * (size_t)h);
+		uint8_t c = 0;
+		for (int k = 0; k < w * h; ++k)
+		{
+			if (rand() % runs == 0)
+				c = (uint8_t)(rand() % colours);
+			pix[k] = c;
+		}
+		if (!roundTrip(pix, w, h, minCodeSize))
+		{
+			fprintf(stderr, "%dx%d, %d colours, min code size %d: failed round trip\n", w, h, colours, minCodeSize);
+			++failed;
+		}
+		free(pix);
+	}
+	printf("%d of %d images round tripped\n", count - failed, count);
+	return failed ? 1 : 0;
+}
@@ -27,6 +27,7 @@ class IffChunk(Enum):
 	CUST_SCENENFO = b"SNFO"
 	CUST_OGGVORB  = b"OGGV"
 	CUST_SPANS    = b"SPAN"
+	CUST_SPANS2   = b"SPN2"
 
 
 class Mask(Enum):
@@ -226,6 +227,41 @@ def makeCustomSpans(pix: bytes, stride: int, crng: list[CycleRange]) -> bytes:
 		computeSpans([pix[i * stride:i * stride + stride] for i in range(len(pix) // stride)], crng))
 
 
+# Static gaps up to this many pixels get merged into the surrounding spans (matches lbmview)
+SPAN_MERGE_GAP = 8
+
+
+def computeSpans2(pixRows: list[bytes], crng: list[CycleRange]) -> bytes:
+	cycling = [any(i.rate != 0 and i.high > i.low and i.low <= p <= i.high for i in crng) for p in range(256)]
+
+	def getSpans(row: bytes) -> list[tuple[int, int]]:
+		spans = []
+		for i, p in enumerate(row):
+			if not cycling[p]:
+				continue
+			if spans and i - spans[-1][1] <= SPAN_MERGE_GAP + 1:
+				spans[-1] = (spans[-1][0], i)
+			else:
+				spans.append((i, i))
+		return spans
+
+	rows = [getSpans(row) for row in pixRows]
+	nonEmpty = [i for i, spans in enumerate(rows) if spans]
+	startOfs, endOfs = (nonEmpty[0], nonEmpty[-1] + 1) if nonEmpty else (0, 0)
+
+	out = bytearray(struct.pack(">HH", startOfs, endOfs - startOfs))
+	for spans in rows[startOfs:endOfs]:
+		out += struct.pack(">H", len(spans))
+		for span in spans:
+			out += struct.pack(">hh", *span)
+	return bytes(out)
+
+
+def makeCustomSpans2(pix: bytes, stride: int, crng: list[CycleRange]) -> bytes:
+	return makeChunk(IffChunk.CUST_SPANS2,
+		computeSpans2([pix[i * stride:i * stride + stride] for i in range(len(pix) // stride)], crng))
+
+
 remove_js = re.compile(r"\((\{[\s\S]*})", re.MULTILINE)
 match_single = re.compile(r"'(.*?)'")
 quote_properties = re.compile(r"(\w*):")
@@ -265,6 +301,8 @@ def convert(inPath: Path, outDir: Path, title: str|None=None, audio: str|None=No
 			if volume is None:
 				volume = 127 if audio is not None else 0
 			chunks.append(makeCustomSceneInfo(title, audio, volume))
+		# SPN2 goes first so newer readers can skip SPAN, which stays for older ones
+		chunks.append(makeCustomSpans2(pix, size[0], crng))
 		chunks.append(makeCustomSpans(pix, size[0], crng))
 		chunks.append(makeChunk(IffChunk.BODY, imgCompress(pix, size[0])))
 		if oggv is not None: